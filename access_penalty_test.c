@@ -8,6 +8,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include "check_mem_latency.h"
+#include "results.h"
 
 #define MECA_DEV "/dev/mem"
 #define MECA_OFFSET 0x200000000UL
@@ -18,17 +19,50 @@ int main(int argc, char **argv)
 {
     double local_mem_latency = 0, meca_mem_latency = 0;
     double temp, min, max, total_latency;
-    void *buf;
     void *local_buf = NULL, *meca_buf = NULL;
-    long test_size = 0, stride = 0;
+    long test_size = 0, stride = 0, buf_size;
     size_t page_size;
     int i, loop;
     int fd;
     int skip_meca_test = 0;
+    int encoding = CHASE_ENC_ABS64;
+    long unroll = 1024;
+    uintptr_t cursor;
+    double overhead;
+    const char *output = NULL, *format = NULL, *baseline = NULL;
+    const char *meca_dev = MECA_DEV;
+    unsigned long meca_offset = MECA_OFFSET;
+    double alpha = 0.01, threshold_pct = 2;
+    struct result_set results;
+    int nargs, out_format, ret = 0;
+
+    // Strip the --options, what remains are the positional arguments
+    for (i = 1, nargs = 1; i < argc; i++) {
+	if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+	    output = argv[++i];
+	else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+	    format = argv[++i];
+	else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc)
+	    baseline = argv[++i];
+	else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc)
+	    alpha = atof(argv[++i]);
+	else if (strcmp(argv[i], "--threshold-pct") == 0 && i + 1 < argc)
+	    threshold_pct = atof(argv[++i]);
+	else if (strcmp(argv[i], "--meca-dev") == 0 && i + 1 < argc)
+	    meca_dev = argv[++i];
+	else if (strcmp(argv[i], "--meca-offset") == 0 && i + 1 < argc)
+	    meca_offset = strtoul(argv[++i], NULL, 0);
+	else
+	    argv[nargs++] = argv[i];
+    }
+    argc = nargs;
 
     if (argc < 5) {
 	printf
-	    ("Usage: %s [size] [stride] [loop count] [skip MECA test 0|1]\n",
+	    ("Usage: %s [size] [stride] [loop count] [skip MECA test 0|1] [encoding abs64|rel32|packed|abs64p] [unroll 16|64|256|1024]\n"
+	     "       [--output FILE] [--format json|csv] [--compare BASELINE] [--alpha A] [--threshold-pct P]\n"
+	     "       [--meca-dev PATH] [--meca-offset OFF], keep clear of the region a running meca_monitor uses\n"
+	     "With --compare the exit status is 2 on a regression, 3 if the baseline could not be compared\n",
 	     argv[0]);
 	return 0;
     }
@@ -37,13 +71,66 @@ int main(int argc, char **argv)
     stride = atol(argv[2]);
     loop = atoi(argv[3]);
 
-    if (argc == 5)
+    if (argc >= 5)
 	skip_meca_test = atoi(argv[4]);
 
+    if (argc >= 6) {
+	encoding = chase_encoding_from_name(argv[5]);
+	if (encoding < 0) {
+	    printf("Unknown encoding: %s\n", argv[5]);
+	    return -1;
+	}
+    }
+
+    if (argc >= 7) {
+	unroll = atol(argv[6]);
+	if (!chase_unroll_supported(unroll)) {
+	    printf("Unsupported unroll: %ld\n", unroll);
+	    return -1;
+	}
+    }
+
+    out_format = results_parse_format(format, output);
+    if (out_format < 0) {
+	printf("Unknown format: %s\n", format);
+	return -1;
+    }
+    if (results_same_file(output, baseline)) {
+	printf("--output would overwrite the --compare baseline\n");
+	return -1;
+    }
+
+    results_init(&results, "access_penalty_test");
+    results_config_num(&results, "size", test_size);
+    results_config_num(&results, "stride", stride);
+    results_config_count(&results, "loop", loop);
+    results_config_str(&results, "pattern", "random_and_sequential");
+    results_config_str(&results, "tiers", skip_meca_test ? "local" : "local,meca");
+    results_config_str(&results, "encoding", argc >= 6 ? argv[5] : "abs64");
+    results_config_num(&results, "footprint", chain_footprint(test_size, encoding));
+    results_config_num(&results, "unroll", unroll);
+    results_config_str(&results, "timer", RESULT_TIMER);
+    results_config_num(&results, "clock_per_usec", CLOCK_PER_USEC);
+    results_config_str(&results, "flush", "l2_flood");
+    results_config_str(&results, "meca_dev", meca_dev);
+    results_config_num(&results, "meca_offset", meca_offset);
+    results_add_host(&results);
+
+    // Clock reads around each chase call, taken off every measurement so
+    // that different unroll depths can be compared
+    overhead = chase_timer_overhead(NULL);
+    printf("Timer overhead: %.3lf cycles per timed window\n", overhead);
+    results_summary_num(&results, "timer_overhead_cycles", overhead);
+
 
     //Allocte Local memory for latency test
     page_size = getpagesize();
-    local_buf = aligned_alloc(page_size, test_size);
+    // The chain is prepared over test_size bytes, then laid out with the
+    // node size of the encoding which may need less or more room
+    buf_size = chain_footprint(test_size, encoding);
+    if (buf_size < test_size)
+	buf_size = test_size;
+    local_buf = aligned_alloc(page_size, buf_size);
     if (local_buf == NULL) {
 	printf("Local Memory allocation error: %s\n", strerror(errno));
 	return -1;
@@ -53,13 +140,19 @@ int main(int argc, char **argv)
 //      prepare_mem_for_latency_test_random(local_buf, test_size, stride);
 //      prepare_mem_for_latency_test_fullrandom(local_buf, test_size, stride);
     prepare_mem_for_latency_test_random_and_sequential(local_buf, test_size, stride);
+    if (convert_chain_encoding(local_buf, test_size, encoding) < 0) {
+	printf("Local Memory chain encoding error: size too large\n");
+	return -1;
+    }
 
     printf("Local Memory Test\n");
     total_latency = 0;
     min = max = 0;
-    buf = local_buf;
+    cursor = 0;
     for (i = 0; i < loop; i++) {
-	temp = check_mem_latency(&buf, test_size, stride);
+	temp = check_mem_latency_enc(local_buf, &cursor, test_size, stride,
+				     encoding, unroll, overhead);
+	results_sample(&results, "local", "latency", "cycles", temp);
 	printf("%d: %.2lf\n", i + 1, temp);
 	fflush(stdout);
 	total_latency += temp;
@@ -74,6 +167,8 @@ int main(int argc, char **argv)
     local_mem_latency = (total_latency - min - max) / (loop - 2);
     printf("Local Memory Latency: average = %.4lf usec\n",
 	   local_mem_latency / CLOCK_PER_USEC);
+    results_summary_num(&results, "local_latency_usec",
+			local_mem_latency / CLOCK_PER_USEC);
 
     free(local_buf);
     //end of Local memory test
@@ -81,30 +176,39 @@ int main(int argc, char **argv)
     if (skip_meca_test == 0) {
 //	stride = 8;
 	//Allocate MECA memory for latency test
-	fd = open(MECA_DEV, O_RDWR);
+	fd = open(meca_dev, O_RDWR);
 	if (fd < 0) {
 	    printf("MECA device open error: %s\n", strerror(errno));
 	    return -1;
 	}
 
 	meca_buf =
-	    mmap(0, test_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-		 MECA_OFFSET);
-	if (meca_buf == NULL) {
+	    mmap(0, buf_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		 meca_offset);
+	if (meca_buf == MAP_FAILED) {
 	    printf("MECA Memory allocation error: %s\n", strerror(errno));
+	    ret = -1;
 	    goto out;
 	}
 //	prepare_mem_for_latency_test(meca_buf, test_size, stride);
 //        prepare_mem_for_latency_test_random(meca_buf, test_size, stride);
 //        prepare_mem_for_latency_test_fullrandom(meca_buf, test_size, stride);
         prepare_mem_for_latency_test_random_and_sequential(meca_buf, test_size, stride);
+	if (convert_chain_encoding(meca_buf, test_size, encoding) < 0) {
+	    printf("MECA Memory chain encoding error: size too large\n");
+	    munmap(meca_buf, buf_size);
+	    ret = -1;
+	    goto out;
+	}
 
 	printf("\nMECA Memory Test\n");
 	total_latency = 0;
 	min = max = 0;
-	buf = meca_buf;
+	cursor = 0;
 	for (i = 0; i < loop; i++) {
-	    temp = check_mem_latency(&buf, test_size, stride);
+	    temp = check_mem_latency_enc(meca_buf, &cursor, test_size, stride,
+					 encoding, unroll, overhead);
+	    results_sample(&results, "meca", "latency", "cycles", temp);
 	    printf("%d: %.2lf\n", i + 1, temp);
 	    fflush(stdout);
 	    total_latency += temp;
@@ -119,6 +223,8 @@ int main(int argc, char **argv)
 	meca_mem_latency = (total_latency - min - max) / (loop - 2);
 	printf("MECA Memory Latency: average = %.4lf usec\n",
 	       meca_mem_latency / CLOCK_PER_USEC);
+	results_summary_num(&results, "meca_latency_usec",
+			    meca_mem_latency / CLOCK_PER_USEC);
 	//end of MECA memory test
 
 	//Calculate Access Penalty
@@ -127,6 +233,9 @@ int main(int argc, char **argv)
 	printf("                  = %lf %%\n",
 	       (meca_mem_latency -
 		local_mem_latency) / local_mem_latency * 100);
+	results_summary_num(&results, "penalty_pct",
+			    (meca_mem_latency -
+			     local_mem_latency) / local_mem_latency * 100);
 
 #if 0
 	printf("\nMECA Memory Test (stride 16)\n");
@@ -157,11 +266,25 @@ int main(int argc, char **argv)
 		local_mem_latency) / local_mem_latency * 100);
 #endif
 
-	munmap(meca_buf, test_size);
+	munmap(meca_buf, buf_size);
 
       out:
 	close(fd);
     }
 
-    return 0;
+    if (output && results_write(&results, output, out_format) < 0)
+	ret = -1;
+
+    // Exit with RESULT_CMP_* so rollouts can be gated on it
+    if (baseline) {
+	int status = results_compare(&results, baseline, alpha,
+				     threshold_pct, stdout);
+	if (status < 0)
+	    ret = -1;
+	else if (ret == 0)
+	    ret = status;
+    }
+
+    results_free(&results);
+    return ret;
 }
@@ -11,20 +11,53 @@
 #include "check_mem_latency.h"
 #include <time.h>
 
-// Pointer chasing macros to force the loop to be unwound
-#define CHASE1(x) ((uintptr_t *)*x)
-#define CHASE2(x) CHASE1(CHASE1(x))
-#define CHASE4(x) CHASE2(CHASE2(x))
-#define CHASE8(x) CHASE4(CHASE4(x))
-#define CHASE16(x) CHASE8(CHASE8(x))
-#define CHASE32(x) CHASE16(CHASE16(x))
-#define CHASE64(x) CHASE32(CHASE32(x))
-#define CHASE128(x) CHASE64(CHASE64(x))
-#define CHASE256(x) CHASE128(CHASE128(x))
-#define CHASE512(x) CHASE256(CHASE256(x))
-#define CHASE1024(x) CHASE512(CHASE512(x))
+// Repeat macros to force the chase loop to be unwound
+#define REPEAT1(s) s
+#define REPEAT2(s) REPEAT1(s) REPEAT1(s)
+#define REPEAT4(s) REPEAT2(s) REPEAT2(s)
+#define REPEAT8(s) REPEAT4(s) REPEAT4(s)
+#define REPEAT16(s) REPEAT8(s) REPEAT8(s)
+#define REPEAT32(s) REPEAT16(s) REPEAT16(s)
+#define REPEAT64(s) REPEAT32(s) REPEAT32(s)
+#define REPEAT128(s) REPEAT64(s) REPEAT64(s)
+#define REPEAT256(s) REPEAT128(s) REPEAT128(s)
+#define REPEAT512(s) REPEAT256(s) REPEAT256(s)
+#define REPEAT1024(s) REPEAT512(s) REPEAT512(s)
 #define CHASE_STEPS 1024
 
+// One chase step per node encoding. 'p' is the cursor, which is an absolute
+// address for ABS64/ABS64P and a byte offset from 'base' for the others.
+#define CHASE_STEP_ABS64(p, base, acc) p = *(uintptr_t *)p;
+#define CHASE_STEP_REL32(p, base, acc) p = *(uint32_t *)(base + p);
+#define CHASE_STEP_PACKED(p, base, acc) { \
+	const struct chase_packed_node *n_ = \
+	    (const struct chase_packed_node *)(base + p); \
+	acc += n_->payload; p = n_->next; }
+#define CHASE_STEP_ABS64P(p, base, acc) { \
+	const struct chase_abs64p_node *n_ = \
+	    (const struct chase_abs64p_node *)p; \
+	acc += n_->payload; p = n_->next; }
+
+// Packed node: 32-bit base-relative next offset followed by a payload word
+// which is read on every step like a real linked structure would.
+struct chase_packed_node {
+    uint32_t next;
+    uint32_t payload;
+};
+
+// Pointer based counterpart of the packed node, to compare the two
+struct chase_abs64p_node {
+    uintptr_t next;
+    uintptr_t payload;
+};
+
+static const long chase_node_size[CHASE_ENC_MAX] = {
+    [CHASE_ENC_ABS64] = sizeof(uintptr_t),
+    [CHASE_ENC_REL32] = sizeof(uint32_t),
+    [CHASE_ENC_PACKED] = sizeof(struct chase_packed_node),
+    [CHASE_ENC_ABS64P] = sizeof(struct chase_abs64p_node),
+};
+
 #ifdef USE_RDCYCLE
 static uintptr_t rdcycle()
 {
@@ -45,15 +78,158 @@ static inline uintptr_t rdcycle()
 }
 #endif
 
-uintptr_t *chase(uintptr_t * x, long *cycles)
+// 'sink' keeps the payload sum of the packed kernels alive. A NULL timer
+// uses the built-in rdcycle().
+typedef uintptr_t (*chase_fn)(char *base, uintptr_t p, long *cycles,
+			      const struct chase_timer *timer, uintptr_t *sink);
+
+#define DEFINE_CHASE_KERNEL(name, step, steps) \
+static uintptr_t chase_##name##_##steps(char *base, uintptr_t p, long *cycles, \
+				const struct chase_timer *timer, uintptr_t *sink) \
+{ \
+    uintptr_t acc = 0; \
+    uintptr_t start = timer ? timer->read(timer->arg) : rdcycle(); \
+    asm volatile ("":::"memory"); \
+    REPEAT##steps(step(p, base, acc)) \
+    asm volatile ("":::"memory"); \
+    uintptr_t end = timer ? timer->read(timer->arg) : rdcycle(); \
+    *cycles = end - start; \
+    *sink += acc; \
+    (void)base; \
+    return p; \
+}
+
+#define DEFINE_CHASE_KERNELS(name, step) \
+    DEFINE_CHASE_KERNEL(name, step, 16) \
+    DEFINE_CHASE_KERNEL(name, step, 64) \
+    DEFINE_CHASE_KERNEL(name, step, 256) \
+    DEFINE_CHASE_KERNEL(name, step, 1024)
+
+DEFINE_CHASE_KERNELS(abs64, CHASE_STEP_ABS64)
+DEFINE_CHASE_KERNELS(rel32, CHASE_STEP_REL32)
+DEFINE_CHASE_KERNELS(packed, CHASE_STEP_PACKED)
+DEFINE_CHASE_KERNELS(abs64p, CHASE_STEP_ABS64P)
+
+#define CHASE_UNROLLS 4
+static const long chase_unrolls[CHASE_UNROLLS] = { 16, 64, 256, 1024 };
+
+// Dispatch table indexed by [encoding][unroll index]
+static const chase_fn chase_table[CHASE_ENC_MAX][CHASE_UNROLLS] = {
+    [CHASE_ENC_ABS64] = { chase_abs64_16, chase_abs64_64,
+			  chase_abs64_256, chase_abs64_1024 },
+    [CHASE_ENC_REL32] = { chase_rel32_16, chase_rel32_64,
+			  chase_rel32_256, chase_rel32_1024 },
+    [CHASE_ENC_PACKED] = { chase_packed_16, chase_packed_64,
+			   chase_packed_256, chase_packed_1024 },
+    [CHASE_ENC_ABS64P] = { chase_abs64p_16, chase_abs64p_64,
+			   chase_abs64p_256, chase_abs64p_1024 },
+};
+
+static const char *chase_encoding_names[CHASE_ENC_MAX] = {
+    [CHASE_ENC_ABS64] = "abs64",
+    [CHASE_ENC_REL32] = "rel32",
+    [CHASE_ENC_PACKED] = "packed",
+    [CHASE_ENC_ABS64P] = "abs64p",
+};
+
+static chase_fn chase_lookup(enum chase_encoding enc, long unroll)
 {
-    uintptr_t start = rdcycle();
-    asm volatile ("":::"memory");
-    uintptr_t *out = CHASE1024(x);
-    asm volatile ("":::"memory");
-    uintptr_t end = rdcycle();
-    *cycles = end - start;
-    return out;
+    int i;
+
+    if ((int)enc < 0 || enc >= CHASE_ENC_MAX)
+	return NULL;
+    for (i = 0; i < CHASE_UNROLLS; i++)
+	if (chase_unrolls[i] == unroll)
+	    return chase_table[enc][i];
+    return NULL;
+}
+
+int chase_encoding_from_name(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CHASE_ENC_MAX; i++)
+	if (strcmp(name, chase_encoding_names[i]) == 0)
+	    return i;
+    return -1;
+}
+
+int chase_unroll_supported(long unroll)
+{
+    return chase_lookup(CHASE_ENC_ABS64, unroll) != NULL;
+}
+
+// Bytes used by a chain prepared over 'size' bytes once laid out with the
+// node size of 'enc'
+long chain_footprint(long size, enum chase_encoding enc)
+{
+    if ((int)enc < 0 || enc >= CHASE_ENC_MAX)
+	return -1;
+    return size / sizeof(uintptr_t) * chase_node_size[enc];
+}
+
+// Lay out a chain built by one of the prepare_mem_for_latency_test_* functions
+// (absolute pointers over size / sizeof(uintptr_t) slots, starting at buf)
+// with the node size of 'enc'. The slot visit order is recorded first and
+// then written back with each node at slot * node size, so every encoding
+// follows the same pattern while compact nodes really take less room.
+// buf must hold at least chain_footprint(size, enc) bytes.
+int convert_chain_encoding(void *buf, long size, enum chase_encoding enc)
+{
+    char *base = (char *) buf;
+    uintptr_t *node = (uintptr_t *) buf;
+    unsigned long slots = size / sizeof(uintptr_t);
+    unsigned long count = 0, i;
+    uint32_t *order;
+
+    if (enc == CHASE_ENC_ABS64)
+	return 0;
+    if ((int)enc < 0 || enc >= CHASE_ENC_MAX || slots > UINT32_MAX)
+	return -1;
+    // 32-bit offsets can only cover 4GB from the base
+    if (enc != CHASE_ENC_ABS64P &&
+	(unsigned long)chain_footprint(size, enc) > (unsigned long)UINT32_MAX + 1)
+	return -1;
+
+    order = malloc(slots * sizeof(uint32_t));
+    if (order == NULL)
+	return -1;
+    do {
+	order[count++] = ((char *)node - base) / sizeof(uintptr_t);
+	node = (uintptr_t *) *node;
+    } while ((char *)node != base && count < slots);
+    if ((char *)node != base) {
+	free(order);
+	return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+	unsigned long cur = order[i];
+	unsigned long next = order[(i + 1) % count];
+
+	switch (enc) {
+	case CHASE_ENC_REL32:
+	    ((uint32_t *)base)[cur] = next * sizeof(uint32_t);
+	    break;
+	case CHASE_ENC_PACKED: {
+	    struct chase_packed_node *pn = (struct chase_packed_node *)base;
+	    pn[cur].next = next * sizeof(*pn);
+	    pn[cur].payload = i;
+	    break;
+	}
+	case CHASE_ENC_ABS64P: {
+	    struct chase_abs64p_node *an = (struct chase_abs64p_node *)base;
+	    an[cur].next = (uintptr_t) &an[next];
+	    an[cur].payload = i;
+	    break;
+	}
+	default:
+	    break;
+	}
+    }
+    free(order);
+
+    return 0;
 }
 
 // To prevent homonyms on a RISC-V for a VIPT system with virtual memory,
@@ -91,7 +267,7 @@ void prepare_mem_for_latency_test(void *buf, long size, long stride)
 
 }
 
-void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, long orig_stride)
+void prepare_mem_for_latency_test_random_and_sequential_r(void *buf, long size, long orig_stride, unsigned int *seed)
 {
     uintptr_t *bigarray = (uintptr_t *) buf;
     uintptr_t * last = NULL;
@@ -101,7 +277,6 @@ void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, lo
 
     // Create a pointer loop
     bzero(buf, size);
-    srand(time(NULL));
     i = 0;
     
     stride = 0;
@@ -119,7 +294,7 @@ void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, lo
 	if (count <= 0 ) break;
 
 	//random stride with orig_stride aligned.
-	stride = (rand()%(size/orig_stride))*orig_stride;
+	stride = (rand_r(seed)%(size/orig_stride))*orig_stride;
 
 	if ( bigarray[stride / sizeof(uintptr_t)] != (uintptr_t) 0 ) {
 	    do { 
@@ -147,7 +322,7 @@ void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, lo
 
 }
 
-void prepare_mem_for_latency_test_random(void *buf, long size, long orig_stride)
+void prepare_mem_for_latency_test_random_r(void *buf, long size, long orig_stride, unsigned int *seed)
 {
     long test_size;
     long test_range = size;
@@ -159,11 +334,10 @@ void prepare_mem_for_latency_test_random(void *buf, long size, long orig_stride)
     test_size = test_range;
 
     // Create a pointer loop
-    srand(time(NULL));
     i = 0;
     do {
 	//random stride with sizeof(uintptr_t) aligned.
-	stride = (rand()%(orig_stride*2/sizeof(uintptr_t)))*sizeof(uintptr_t);
+	stride = (rand_r(seed)%(orig_stride*2/sizeof(uintptr_t)))*sizeof(uintptr_t);
 
 	if ( (i + stride) >= size ) j = 0;
 	else j = (i + stride) & (test_size - 1);
@@ -185,7 +359,7 @@ void prepare_mem_for_latency_test_random(void *buf, long size, long orig_stride)
 
 }
 
-void prepare_mem_for_latency_test_fullrandom(void *buf, long size, long orig_stride)
+void prepare_mem_for_latency_test_fullrandom_r(void *buf, long size, long orig_stride, unsigned int *seed)
 {
     uintptr_t *bigarray = (uintptr_t *) buf;;
     long i;
@@ -195,11 +369,10 @@ void prepare_mem_for_latency_test_fullrandom(void *buf, long size, long orig_str
     bzero(buf, size);
 
     // Create a pointer loop
-    srand(time(NULL));
     i = 0;
     do {
 	//random stride(position)
-	stride = (rand()%(size/sizeof(uintptr_t)))*sizeof(uintptr_t);
+	stride = (rand_r(seed)%(size/sizeof(uintptr_t)))*sizeof(uintptr_t);
 
 	if ( bigarray[stride / sizeof(uintptr_t)] != (uintptr_t) 0 ) {
 		//continue;
@@ -230,21 +403,127 @@ void prepare_mem_for_latency_test_fullrandom(void *buf, long size, long orig_str
 
 
 
+// Seeded from the clock, for callers that do not care about the seed
+
+void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, long stride)
+{
+    unsigned int seed = time(NULL);
+
+    prepare_mem_for_latency_test_random_and_sequential_r(buf, size, stride, &seed);
+}
+
+void prepare_mem_for_latency_test_random(void *buf, long size, long stride)
+{
+    unsigned int seed = time(NULL);
+
+    prepare_mem_for_latency_test_random_r(buf, size, stride, &seed);
+}
+
+void prepare_mem_for_latency_test_fullrandom(void *buf, long size, long stride)
+{
+    unsigned int seed = time(NULL);
+
+    prepare_mem_for_latency_test_fullrandom_r(buf, size, stride, &seed);
+}
+
 #define L2_CACHE_SIZE (128*1024)
 
-double check_mem_latency(void **buf, long size, long stride)
+#define CALIBRATION_WINDOWS 4096
+
+// Mean ticks of an empty timed window, i.e. what the clock reads add to every
+// chase call. With a coarse timer most windows read 0 and a few read one
+// tick, so the mean is the expected bias rather than the minimum.
+double chase_timer_overhead(const struct chase_timer *timer)
+{
+    uintptr_t start, end;
+    double sum = 0;
+    long i;
+
+    for (i = 0; i < CALIBRATION_WINDOWS; i++) {
+	start = timer ? timer->read(timer->arg) : rdcycle();
+	asm volatile ("":::"memory");
+	asm volatile ("":::"memory");
+	end = timer ? timer->read(timer->arg) : rdcycle();
+	sum += end - start;
+    }
+    return sum / CALIBRATION_WINDOWS;
+}
+
+// Chase 'calls' times 'unroll' steps from *cursor without flooding the caches
+// first, so it is cheap enough to be sampled periodically.
+// 'overhead' (from chase_timer_overhead()) is taken off every call so that
+// results of different unroll depths can be compared. Returns the mean
+// ticks per step, or NAN on error.
+double chase_mem_latency(void *base, uintptr_t *cursor,
+			 enum chase_encoding enc, long unroll, long calls,
+			 double overhead)
+{
+    return chase_mem_latency_timed(base, cursor, enc, unroll, calls, NULL,
+				   overhead);
+}
+
+// Same as chase_mem_latency() but reads the clock through 'timer'
+double chase_mem_latency_timed(void *base, uintptr_t *cursor,
+			       enum chase_encoding enc, long unroll, long calls,
+			       const struct chase_timer *timer, double overhead)
+{
+    long i, delta;
+    long sum, sum2;
+    uintptr_t x = *cursor;
+    uintptr_t sink = 0;
+    chase_fn chase = chase_lookup(enc, unroll);
+
+    if (chase == NULL || calls <= 0)
+	return NAN;
+
+    // ABS64 kernels walk absolute addresses, the cursor is kept relative
+    if (enc == CHASE_ENC_ABS64 || enc == CHASE_ENC_ABS64P)
+	x += (uintptr_t) base;
+
+    // Perform iterations for real
+    sum = 0;
+    sum2 = 0;
+    for (i = 0; i < calls; ++i) {
+	x = chase((char *) base, x, &delta, timer, &sink);
+	sum += delta;
+	sum2 += delta * delta;
+    }
+
+    double mean = (sum - calls * overhead) / (1.0 * calls * unroll);
+    // A coarse timer reads 0 for most short windows, so the corrected sum
+    // can drop below zero; that only says the chase was below resolution.
+    if (mean < 0)
+	mean = 0;
+    // This is tricky. The sum2 and sum are actually measuring the random variable
+    // which is a unroll* sum of the real random variable. To find the variance
+    // of the underlying distribution, we need to multiply by sqrt(unroll).
+    // We also need to divide by unroll to scale the result.
+//    double varDelta = (1.0 * sum2 - 1.0 * sum * sum / calls) / (calls - 1);
+//    double var = varDelta / sqrt(unroll);
+//    printf("%.3lf %.3lf %ld\n", mean, sqrt(var), calls);
+
+    asm volatile ("" : : "r"(sink));
+    if (enc == CHASE_ENC_ABS64 || enc == CHASE_ENC_ABS64P)
+	x -= (uintptr_t) base;
+    *cursor = x;
+    // return mean latency clocks
+    return mean;
+}
+
+double check_mem_latency_enc(void *base, uintptr_t *cursor, long size,
+			     long stride, enum chase_encoding enc, long unroll,
+			     double overhead)
 {
 
     long test_size;
     long test_range = size;
     long ways = 4;		//cache ways
-    uintptr_t *bigarray = (uintptr_t *) *buf;;
-    long i, n, delta;
-    long sum, sum2;
-    uintptr_t *x = &bigarray[0];
+    long i, n;
     long flood_data[L2_CACHE_SIZE/sizeof(long)] = {0};
     long temp = 0;
 
+    if (chase_lookup(enc, unroll) == NULL)
+	return NAN;
 
     test_size = test_range;
 
@@ -255,32 +534,25 @@ double check_mem_latency(void **buf, long size, long stride)
     }
 
     // We need to chase the point test_size/STRIDE steps to exercise the loop.
-    // Each invocation of chase performs CHASE_STEPS, so round-up the calls.
+    // Each invocation of chase performs unroll steps, so round-up the calls.
     // To warm a cache with random replacement, you need to walk it 'ways' times.
-    n = (((test_size / stride) * ways + (CHASE_STEPS - 1)) / CHASE_STEPS);
+    n = (((test_size / stride) * ways + (unroll - 1)) / unroll);
     if (n < 5)
 	n = 5;			// enough to compute variance to within 50% = 1/sqrt(n-1)
-    n = 4096;
+    // Same total number of steps whatever the unroll depth is
+    n = 4096 * CHASE_STEPS / unroll;
 
-    // Perform iterations for real
-    sum = 0;
-    sum2 = 0;
-    for (i = 0; i < n; ++i) {
-	x = chase(x, &delta);
-	sum += delta;
-	sum2 += delta * delta;
-    }
+    return chase_mem_latency(base, cursor, enc, unroll, n, overhead);
+}
 
-    double mean = sum / (1.0 * n * CHASE_STEPS);
-    // This is tricky. The sum2 and sum are actually measuring the random variable
-    // which is a CHASE_STEPS* sum of the real random variable. To find the variance
-    // of the underlying distribution, we need to multiply by sqrt(CHASE_STEPS).
-    // We also need to divide by CHASE_STEPS to scale the result.
-//    double varDelta = (1.0 * sum2 - 1.0 * sum * sum / n) / (n - 1);
-//    double var = varDelta / sqrt(CHASE_STEPS);
-//    printf("%ld %.3lf %.3lf %ld\n", test_size, mean, sqrt(var), n);
-
-    *buf = (void*) x;
-    // return mean latency clocks
+double check_mem_latency(void **buf, long size, long stride)
+{
+    uintptr_t cursor = 0;
+    double mean;
+
+    // No overhead correction, as before
+    mean = check_mem_latency_enc(*buf, &cursor, size, stride,
+				 CHASE_ENC_ABS64, CHASE_STEPS, 0);
+    *buf = (char *) *buf + cursor;
     return mean;
 }
@@ -1,6 +1,39 @@
+#ifndef CHECK_MEM_LATENCY_H
+#define CHECK_MEM_LATENCY_H
+#include <stdint.h>
 #define CLOCK_PER_USEC 100 //100MHz
+enum chase_encoding {
+    CHASE_ENC_ABS64,	// 64-bit absolute pointer per node
+    CHASE_ENC_REL32,	// 32-bit byte offset from the buffer base
+    CHASE_ENC_PACKED,	// 32-bit offset plus a 32-bit payload read on each step
+    CHASE_ENC_ABS64P,	// 64-bit pointer plus a 64-bit payload, 16 bytes per node
+    CHASE_ENC_MAX
+};
+// Clock used around each chase, in ticks
+struct chase_timer {
+    uintptr_t (*read)(void *arg);
+    void *arg;
+};
 void prepare_mem_for_latency_test(void *buf, long size, long stride);
 void prepare_mem_for_latency_test_random(void *buf, long size, long stride);
 void prepare_mem_for_latency_test_fullrandom(void *buf, long size, long stride);
 void prepare_mem_for_latency_test_random_and_sequential(void *buf, long size, long stride);
+void prepare_mem_for_latency_test_random_r(void *buf, long size, long stride, unsigned int *seed);
+void prepare_mem_for_latency_test_fullrandom_r(void *buf, long size, long stride, unsigned int *seed);
+void prepare_mem_for_latency_test_random_and_sequential_r(void *buf, long size, long stride, unsigned int *seed);
+long chain_footprint(long size, enum chase_encoding enc);
+int convert_chain_encoding(void *buf, long size, enum chase_encoding enc);
+int chase_encoding_from_name(const char *name);
+int chase_unroll_supported(long unroll);
+double chase_timer_overhead(const struct chase_timer *timer);
+double chase_mem_latency(void *base, uintptr_t *cursor,
+			 enum chase_encoding enc, long unroll, long calls,
+			 double overhead);
+double chase_mem_latency_timed(void *base, uintptr_t *cursor,
+			       enum chase_encoding enc, long unroll, long calls,
+			       const struct chase_timer *timer, double overhead);
 double check_mem_latency(void **buf, long size, long stride);
+double check_mem_latency_enc(void *base, uintptr_t *cursor, long size,
+			     long stride, enum chase_encoding enc, long unroll,
+			     double overhead);
+#endif
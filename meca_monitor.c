@@ -0,0 +1,508 @@
+// meca_monitor.c
+// Long running MECA health monitor. Every interval it chases a short random
+// chain on local and MECA memory, keeps rolling percentiles of the latency
+// and publishes them with the access penalty into a shared-memory segment
+// (see meca_monitor.h) and, optionally, a Prometheus text file.
+//
+// Usage:  ./meca_monitor [--interval S] [--size B] [--steps N] [--budget-pct P]
+//                        [--window N] [--skip-meca 0|1] [--shm NAME]
+//                        [--prom FILE] [--count N]
+//                        [--meca-dev PATH] [--meca-offset OFF]
+//         ./meca_monitor --dump [--shm NAME]
+//
+// The monitor keeps its chain in the MECA region for as long as it runs, so
+// give it --size bytes at --meca-offset that no other test uses;
+// access_penalty_test and memlat_runner default to the same offset. If the
+// chain gets overwritten anyway, the sample is dropped and the chain rebuilt
+// (counted in meca_rebuilds).
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "check_mem_latency.h"
+#include "meca_monitor.h"
+
+#define MECA_DEV "/dev/mem"
+#define MECA_OFFSET 0x200000000UL
+
+#define CHAIN_STRIDE 64		// one node per cache line on average
+#define SAMPLE_UNROLL 256
+#define MAX_WINDOW 1024
+
+typedef struct {
+    double interval;		// seconds between samples
+    size_t size;		// chain buffer size per tier
+    long steps;			// chase steps per tier per sample (upper bound)
+    double budget_pct;		// max share of the interval spent sampling
+    long window;		// samples used for the rolling percentiles
+    int skip_meca;
+    const char *meca_dev;
+    unsigned long meca_offset;
+    const char *shm_name;
+    const char *prom_path;
+    long count;			// samples to take, 0 = run until signalled
+    int dump;
+} config_t;
+
+struct tier_window {
+    double v[MAX_WINDOW];
+    long n;
+    long pos;
+};
+
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t chasing;
+static sigjmp_buf chase_env;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+// A fault while chasing the MECA chain means the chain was overwritten
+static void on_fault(int sig)
+{
+    if (chasing)
+	siglongjmp(chase_env, 1);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+static void parse_args(int argc, char **argv, config_t *cfg)
+{
+    cfg->interval = 10;
+    cfg->size = 64UL << 20;	// 64 MiB
+    cfg->steps = 4096;
+    cfg->budget_pct = 1;
+    cfg->window = 64;
+    cfg->skip_meca = 0;
+    cfg->meca_dev = MECA_DEV;
+    cfg->meca_offset = MECA_OFFSET;
+    cfg->shm_name = MECA_MON_SHM_NAME;
+    cfg->prom_path = NULL;
+    cfg->count = 0;
+    cfg->dump = 0;
+
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+	    cfg->interval = atof(argv[++i]);
+	    if (cfg->interval <= 0) die("bad --interval");
+	} else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+	    cfg->size = strtoull(argv[++i], NULL, 10);
+	} else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+	    cfg->steps = atol(argv[++i]);
+	    if (cfg->steps < SAMPLE_UNROLL) die("bad --steps");
+	} else if (strcmp(argv[i], "--budget-pct") == 0 && i + 1 < argc) {
+	    cfg->budget_pct = atof(argv[++i]);
+	    if (cfg->budget_pct <= 0 || cfg->budget_pct > 100)
+		die("bad --budget-pct");
+	} else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+	    cfg->window = atol(argv[++i]);
+	    if (cfg->window <= 0 || cfg->window > MAX_WINDOW)
+		die("bad --window");
+	} else if (strcmp(argv[i], "--skip-meca") == 0 && i + 1 < argc) {
+	    cfg->skip_meca = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "--meca-dev") == 0 && i + 1 < argc) {
+	    cfg->meca_dev = argv[++i];
+	} else if (strcmp(argv[i], "--meca-offset") == 0 && i + 1 < argc) {
+	    cfg->meca_offset = strtoul(argv[++i], NULL, 0);
+	} else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+	    cfg->shm_name = argv[++i];
+	} else if (strcmp(argv[i], "--prom") == 0 && i + 1 < argc) {
+	    cfg->prom_path = argv[++i];
+	} else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+	    cfg->count = atol(argv[++i]);
+	} else if (strcmp(argv[i], "--dump") == 0) {
+	    cfg->dump = 1;
+	} else if (strcmp(argv[i], "--help") == 0) {
+	    printf("Usage: %s [--interval S] [--size B] [--steps N] [--budget-pct P] [--window N] [--skip-meca 0|1] [--shm NAME] [--prom FILE] [--count N]\n"
+		   "       [--meca-dev PATH] [--meca-offset OFF]\n"
+		   "       %s --dump [--shm NAME]\n"
+		   "The MECA region at --meca-offset must not be used by any other test while the monitor runs\n",
+		   argv[0], argv[0]);
+	    exit(0);
+	} else {
+	    fprintf(stderr, "Unknown arg: %s\n", argv[i]);
+	    exit(1);
+	}
+    }
+    if (cfg->size < CHAIN_STRIDE * 2)
+	die("--size too small");
+}
+
+static uint64_t nsec_now(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void window_add(struct tier_window *w, long window, double v)
+{
+    w->v[w->pos] = v;
+    w->pos = (w->pos + 1) % window;
+    if (w->n < window)
+	w->n++;
+}
+
+// Nearest-rank percentiles of the current window
+static void window_stats(const struct tier_window *w, struct meca_mon_tier *t)
+{
+    double sorted[MAX_WINDOW];
+    long n = w->n;
+
+    memcpy(sorted, w->v, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    t->min = sorted[0];
+    t->max = sorted[n - 1];
+    t->p50 = sorted[(n * 50 + 99) / 100 - 1];
+    t->p90 = sorted[(n * 90 + 99) / 100 - 1];
+    t->p99 = sorted[(n * 99 + 99) / 100 - 1];
+}
+
+static void write_prom(const char *path, const struct meca_mon_shm *s,
+		       int skip_meca)
+{
+    char tmp[4096];
+    FILE *fp;
+    const struct meca_mon_tier *tiers[2] = { &s->local, &s->meca };
+    const char *names[2] = { "local", "meca" };
+    int i;
+
+    // Write to a temporary file and rename it so the textfile collector
+    // never sees a partial file
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+	fprintf(stderr, "Prometheus file open error: %s\n", strerror(errno));
+	return;
+    }
+
+    fprintf(fp, "# HELP meca_monitor_latency_ns Rolling memory access latency.\n");
+    fprintf(fp, "# TYPE meca_monitor_latency_ns gauge\n");
+    for (i = 0; i < (skip_meca ? 1 : 2); i++) {
+	fprintf(fp, "meca_monitor_latency_ns{tier=\"%s\",quantile=\"0.5\"} %.3f\n",
+		names[i], tiers[i]->p50);
+	fprintf(fp, "meca_monitor_latency_ns{tier=\"%s\",quantile=\"0.9\"} %.3f\n",
+		names[i], tiers[i]->p90);
+	fprintf(fp, "meca_monitor_latency_ns{tier=\"%s\",quantile=\"0.99\"} %.3f\n",
+		names[i], tiers[i]->p99);
+    }
+    fprintf(fp, "# HELP meca_monitor_samples_total Latency samples taken.\n");
+    fprintf(fp, "# TYPE meca_monitor_samples_total counter\n");
+    for (i = 0; i < (skip_meca ? 1 : 2); i++)
+	fprintf(fp, "meca_monitor_samples_total{tier=\"%s\"} %llu\n",
+		names[i], (unsigned long long)tiers[i]->samples);
+    if (!skip_meca) {
+	fprintf(fp, "# HELP meca_monitor_penalty_percent MECA access penalty over local memory (p50).\n");
+	fprintf(fp, "# TYPE meca_monitor_penalty_percent gauge\n");
+	fprintf(fp, "meca_monitor_penalty_percent %.3f\n", s->penalty_pct);
+	fprintf(fp, "# HELP meca_monitor_chain_rebuilds_total Times the MECA chain was found overwritten.\n");
+	fprintf(fp, "# TYPE meca_monitor_chain_rebuilds_total counter\n");
+	fprintf(fp, "meca_monitor_chain_rebuilds_total %llu\n",
+		(unsigned long long)s->meca_rebuilds);
+    }
+    fclose(fp);
+
+    if (rename(tmp, path) < 0)
+	fprintf(stderr, "Prometheus file rename error: %s\n", strerror(errno));
+}
+
+static int dump_shm(const char *name)
+{
+    const struct meca_mon_shm *shm;
+    struct meca_mon_shm snap;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+	printf("Shared memory open error: %s\n", strerror(errno));
+	return -1;
+    }
+    shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+	printf("Shared memory map error: %s\n", strerror(errno));
+	return -1;
+    }
+    if (meca_mon_read(shm, &snap) < 0) {
+	printf("Shared memory segment is not initialized\n");
+	munmap((void *)shm, sizeof(*shm));
+	return -1;
+    }
+
+    printf("pid %llu, interval %llu ms, %llu steps/sample\n",
+	   (unsigned long long)snap.pid,
+	   (unsigned long long)snap.interval_ms,
+	   (unsigned long long)snap.steps_per_sample);
+    printf("Local: last %.2f p50 %.2f p90 %.2f p99 %.2f ns (%llu samples)\n",
+	   snap.local.last, snap.local.p50, snap.local.p90, snap.local.p99,
+	   (unsigned long long)snap.local.samples);
+    if (snap.meca.samples) {
+	printf("MECA:  last %.2f p50 %.2f p90 %.2f p99 %.2f ns (%llu samples)\n",
+	       snap.meca.last, snap.meca.p50, snap.meca.p90, snap.meca.p99,
+	       (unsigned long long)snap.meca.samples);
+	printf("Access Penalty(%%) = %.3f %%\n", snap.penalty_pct);
+	printf("MECA chain rebuilds: %llu\n",
+	       (unsigned long long)snap.meca_rebuilds);
+    }
+
+    munmap((void *)shm, sizeof(*shm));
+    return 0;
+}
+
+// Whether 'name' holds a segment left behind by a meca_monitor that is no
+// longer running. Segments of live monitors, of other programs and ones
+// that cannot be read are never considered stale.
+static int shm_is_stale(const char *name)
+{
+    const struct meca_mon_shm *shm;
+    struct meca_mon_shm snap;
+    struct stat st;
+    int fd, ret;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+	return 0;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*shm)) {
+	close(fd);
+	return 0;
+    }
+    shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+	return 0;
+    ret = meca_mon_read(shm, &snap) == 0 && snap.pid > 0 &&
+	kill((pid_t)snap.pid, 0) < 0 && errno == ESRCH;
+    munmap((void *)shm, sizeof(*shm));
+    return ret;
+}
+
+// Create the segment, taking over a stale one. Returns the descriptor, or
+// -1 with errno EEXIST when the name is in use.
+static int create_shm(const char *name)
+{
+    int fd;
+
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd >= 0 || errno != EEXIST)
+	return fd;
+    if (!shm_is_stale(name)) {
+	errno = EEXIST;
+	return -1;
+    }
+    printf("Removing stale shared memory segment %s\n", name);
+    shm_unlink(name);
+    return shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+}
+
+static void build_meca_chain(void *buf, size_t size)
+{
+    prepare_mem_for_latency_test_fullrandom(buf, size, CHAIN_STRIDE);
+    if (convert_chain_encoding(buf, size, CHASE_ENC_REL32) < 0)
+	die("MECA chain encoding failed, --size too large");
+}
+
+// Chase the MECA chain, which another program pointed at the same region
+// may overwrite. With rel32 nodes a clobbered node sends the chase
+// somewhere in the 4 GB above the buffer: it either faults or ends with a
+// cursor outside the chain. Returns NAN in both cases.
+static double chase_meca(void *buf, uintptr_t *cursor, long footprint,
+			 long calls, double overhead)
+{
+    double v;
+
+    if (sigsetjmp(chase_env, 1)) {
+	chasing = 0;
+	return NAN;
+    }
+    chasing = 1;
+    v = chase_mem_latency(buf, cursor, CHASE_ENC_REL32, SAMPLE_UNROLL, calls,
+			  overhead);
+    chasing = 0;
+    if (*cursor >= (uintptr_t)footprint || *cursor % sizeof(uint32_t))
+	return NAN;
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    config_t cfg;
+    struct meca_mon_shm *shm;
+    static struct tier_window local_win, meca_win;
+    void *local_buf = NULL, *meca_buf = NULL;
+    uintptr_t local_cursor = 0, meca_cursor = 0;
+    long calls, max_calls, taken, meca_footprint = 0;
+    uint64_t meca_rebuilds = 0;
+    double overhead;
+    uint64_t budget_ns, interval_ns, start, cost;
+    struct timespec next;
+    int shm_fd, meca_fd = -1;
+
+    parse_args(argc, argv, &cfg);
+    if (cfg.dump)
+	return dump_shm(cfg.shm_name) < 0 ? 1 : 0;
+
+    interval_ns = (uint64_t)(cfg.interval * 1e9);
+    budget_ns = (uint64_t)(interval_ns * cfg.budget_pct / 100);
+    max_calls = cfg.steps / SAMPLE_UNROLL;
+    calls = max_calls;
+    overhead = chase_timer_overhead(NULL);
+
+    local_buf = aligned_alloc(getpagesize(), cfg.size);
+    if (local_buf == NULL)
+	die("local memory allocation failed");
+    prepare_mem_for_latency_test_fullrandom(local_buf, cfg.size, CHAIN_STRIDE);
+
+    if (!cfg.skip_meca) {
+	meca_fd = open(cfg.meca_dev, O_RDWR);
+	if (meca_fd < 0)
+	    die("failed to open --meca-dev (need root privileges)");
+	meca_buf = mmap(NULL, cfg.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			meca_fd, cfg.meca_offset);
+	if (meca_buf == MAP_FAILED)
+	    die("mmap failed on MECA memory region");
+	build_meca_chain(meca_buf, cfg.size);
+	meca_footprint = chain_footprint(cfg.size, CHASE_ENC_REL32);
+	signal(SIGSEGV, on_fault);
+	signal(SIGBUS, on_fault);
+    }
+
+    shm_fd = create_shm(cfg.shm_name);
+    if (shm_fd < 0 && errno == EEXIST)
+	die("shared memory segment is in use by another process; "
+	    "pick another --shm name or remove it");
+    if (shm_fd < 0)
+	die("shm_open failed");
+    if (ftruncate(shm_fd, sizeof(*shm)) < 0)
+	die("ftruncate failed on shared memory");
+    shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+	       shm_fd, 0);
+    if (shm == MAP_FAILED)
+	die("mmap failed on shared memory");
+    close(shm_fd);
+
+    meca_mon_write_begin(shm);
+    memset(&shm->pid, 0, sizeof(*shm) - offsetof(struct meca_mon_shm, pid));
+    shm->magic = MECA_MON_MAGIC;
+    shm->version = MECA_MON_VERSION;
+    shm->ring_size = MECA_MON_RING;
+    shm->pid = getpid();
+    shm->interval_ms = interval_ns / 1000000;
+    meca_mon_write_end(shm);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (taken = 0; !stop && (cfg.count == 0 || taken < cfg.count); taken++) {
+	struct meca_mon_sample sample = { 0 };
+	double penalty = 0;
+	int meca_ok = 0;
+
+	start = nsec_now(CLOCK_MONOTONIC);
+	sample.local_ns = chase_mem_latency(local_buf, &local_cursor,
+					    CHASE_ENC_ABS64, SAMPLE_UNROLL,
+					    calls, overhead) * 1000 / CLOCK_PER_USEC;
+	if (!cfg.skip_meca) {
+	    sample.meca_ns = chase_meca(meca_buf, &meca_cursor, meca_footprint,
+					calls, overhead) * 1000 / CLOCK_PER_USEC;
+	    if (isnan(sample.meca_ns)) {
+		fprintf(stderr, "MECA chain was overwritten, rebuilding it "
+			"(is another test using %s at 0x%lx?)\n",
+			cfg.meca_dev, cfg.meca_offset);
+		build_meca_chain(meca_buf, cfg.size);
+		meca_cursor = 0;
+		sample.meca_ns = 0;
+		meca_rebuilds++;
+	    } else {
+		meca_ok = 1;
+	    }
+	}
+	cost = nsec_now(CLOCK_MONOTONIC) - start;
+	sample.timestamp_ns = nsec_now(CLOCK_REALTIME);
+
+	window_add(&local_win, cfg.window, sample.local_ns);
+	if (meca_ok)
+	    window_add(&meca_win, cfg.window, sample.meca_ns);
+
+	meca_mon_write_begin(shm);
+	shm->steps_per_sample = calls * SAMPLE_UNROLL;
+	shm->updated_ns = sample.timestamp_ns;
+	shm->local.last = sample.local_ns;
+	shm->local.samples++;
+	window_stats(&local_win, &shm->local);
+	shm->meca_rebuilds = meca_rebuilds;
+	if (meca_ok) {
+	    shm->meca.last = sample.meca_ns;
+	    shm->meca.samples++;
+	    window_stats(&meca_win, &shm->meca);
+	    if (shm->local.p50 > 0)
+		penalty = (shm->meca.p50 - shm->local.p50) / shm->local.p50 * 100;
+	    shm->penalty_pct = penalty;
+	}
+	shm->ring[shm->head % MECA_MON_RING] = sample;
+	shm->head++;
+	meca_mon_write_end(shm);
+
+	if (cfg.prom_path)
+	    write_prom(cfg.prom_path, shm, cfg.skip_meca);
+
+	// Stay within the CPU budget: shrink the chase when a sample costs
+	// more than allowed, grow it back when there is plenty of headroom.
+	if (cost > budget_ns && calls > 1)
+	    calls /= 2;
+	else if (cost * 4 < budget_ns && calls < max_calls)
+	    calls *= 2;
+	if (calls > max_calls)
+	    calls = max_calls;
+
+	if (cfg.count && taken + 1 >= cfg.count)
+	    break;
+	next.tv_sec += interval_ns / 1000000000;
+	next.tv_nsec += interval_ns % 1000000000;
+	if (next.tv_nsec >= 1000000000) {
+	    next.tv_sec++;
+	    next.tv_nsec -= 1000000000;
+	}
+	while (!stop && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					&next, NULL) == EINTR)
+	    ;
+    }
+
+    // create_shm() made the segment, so it is ours to remove
+    shm_unlink(cfg.shm_name);
+    munmap(shm, sizeof(*shm));
+    if (!cfg.skip_meca) {
+	munmap(meca_buf, cfg.size);
+	close(meca_fd);
+    }
+    free(local_buf);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Shared-memory layout published by meca_monitor.
+//
+// The segment is written by a single meca_monitor process and protected by a
+// sequence lock, so readers only need to mmap it once and can then take
+// snapshots without any syscall:
+//
+//	int fd = shm_open(MECA_MON_SHM_NAME, O_RDONLY, 0);
+//	const struct meca_mon_shm *shm =
+//	    mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+//	struct meca_mon_shm snap;
+//	meca_mon_read(shm, &snap);
+#ifndef MECA_MONITOR_H
+#define MECA_MONITOR_H
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define MECA_MON_SHM_NAME "/meca_monitor"
+#define MECA_MON_MAGIC 0x314e4f4d4143454dULL	// "MECAMON1"
+#define MECA_MON_VERSION 2
+#define MECA_MON_RING 64	// raw samples kept in the ring
+#define MECA_MON_READ_TRIES (1L << 20)	// before giving up on an odd seq
+
+// Rolling statistics of one memory tier, latencies in nanoseconds
+struct meca_mon_tier {
+    double last;
+    double p50;
+    double p90;
+    double p99;
+    double min;
+    double max;
+    uint64_t samples;		// total number of samples taken
+};
+
+struct meca_mon_sample {
+    uint64_t timestamp_ns;	// CLOCK_REALTIME
+    double local_ns;
+    double meca_ns;		// 0 if MECA is not sampled
+};
+
+struct meca_mon_shm {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    _Atomic uint64_t seq;	// odd while the writer is updating
+    uint64_t pid;		// writer process
+    uint64_t interval_ms;
+    uint64_t steps_per_sample;	// chase steps per tier per sample
+    uint64_t updated_ns;	// CLOCK_REALTIME of the last update
+    struct meca_mon_tier local;
+    struct meca_mon_tier meca;
+    double penalty_pct;		// (meca p50 - local p50) / local p50 * 100
+    uint64_t meca_rebuilds;	// times the MECA chain was found overwritten
+    uint64_t head;		// samples written, ring[(head - 1) % ring_size] is the latest
+    struct meca_mon_sample ring[MECA_MON_RING];
+};
+
+static inline void meca_mon_write_begin(struct meca_mon_shm *shm)
+{
+    uint64_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void meca_mon_write_end(struct meca_mon_shm *shm)
+{
+    uint64_t seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm->seq, seq + 1, memory_order_release);
+}
+
+// Take a consistent copy of the segment. Returns 0 on success, -1 if the
+// segment is not (yet) a valid meca_monitor segment or its writer died in
+// the middle of an update.
+static inline int meca_mon_read(const struct meca_mon_shm *shm,
+				struct meca_mon_shm *snap)
+{
+    uint64_t seq1, seq2;
+    long tries = MECA_MON_READ_TRIES;
+
+    do {
+	if (tries-- == 0)
+	    return -1;
+	seq1 = atomic_load_explicit((_Atomic uint64_t *)&shm->seq,
+				    memory_order_acquire);
+	if (seq1 & 1)
+	    continue;
+	memcpy(snap, shm, sizeof(*snap));
+	atomic_thread_fence(memory_order_acquire);
+	seq2 = atomic_load_explicit((_Atomic uint64_t *)&shm->seq,
+				    memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+
+    if (snap->magic != MECA_MON_MAGIC || snap->version != MECA_MON_VERSION)
+	return -1;
+    return 0;
+}
+#endif
@@ -0,0 +1,339 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "check_mem_latency.h"
+#include "memlat.h"
+
+_Static_assert((int)MEMLAT_ENC_ABS64 == CHASE_ENC_ABS64 &&
+	       (int)MEMLAT_ENC_REL32 == CHASE_ENC_REL32 &&
+	       (int)MEMLAT_ENC_PACKED == CHASE_ENC_PACKED &&
+	       (int)MEMLAT_ENC_ABS64P == CHASE_ENC_ABS64P &&
+	       (int)MEMLAT_ENC_MAX == CHASE_ENC_MAX,
+	       "memlat_encoding must mirror chase_encoding");
+
+static const char *memlat_pattern_names[MEMLAT_PAT_MAX] = {
+    [MEMLAT_PAT_SEQUENTIAL] = "sequential",
+    [MEMLAT_PAT_RANDOM] = "random",
+    [MEMLAT_PAT_FULLRANDOM] = "fullrandom",
+    [MEMLAT_PAT_RANDOM_AND_SEQUENTIAL] = "random_and_sequential",
+};
+
+static int local_alloc(void *arg, size_t size, struct memlat_buffer *buf)
+{
+    (void)arg;
+    buf->base = aligned_alloc(getpagesize(), size);
+    if (buf->base == NULL)
+	return -1;
+    buf->size = size;
+    buf->priv = NULL;
+    return 0;
+}
+
+static void local_release(void *arg, struct memlat_buffer *buf)
+{
+    (void)arg;
+    free(buf->base);
+    buf->base = NULL;
+}
+
+static int devmem_alloc(void *arg, size_t size, struct memlat_buffer *buf)
+{
+    struct memlat_devmem *dm = arg;
+    int fd;
+
+    fd = open(dm->dev, O_RDWR);
+    if (fd < 0)
+	return -1;
+    buf->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		     dm->offset);
+    close(fd);
+    if (buf->base == MAP_FAILED) {
+	buf->base = NULL;
+	return -1;
+    }
+    buf->size = size;
+    buf->priv = NULL;
+    return 0;
+}
+
+static void devmem_release(void *arg, struct memlat_buffer *buf)
+{
+    (void)arg;
+    munmap(buf->base, buf->size);
+    buf->base = NULL;
+}
+
+void memlat_provider_local(struct memlat_provider *p)
+{
+    p->name = "local";
+    p->alloc = local_alloc;
+    p->release = local_release;
+    p->arg = NULL;
+}
+
+void memlat_provider_devmem(struct memlat_provider *p, struct memlat_devmem *dm)
+{
+    p->name = "devmem";
+    p->alloc = devmem_alloc;
+    p->release = devmem_release;
+    p->arg = dm;
+}
+
+void memlat_ctx_init(struct memlat_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    memlat_provider_local(&ctx->provider);
+    ctx->pattern = MEMLAT_PAT_RANDOM_AND_SEQUENTIAL;
+    ctx->encoding = MEMLAT_ENC_ABS64;
+    ctx->unroll = 1024;
+    ctx->steps = 4096 * 1024;
+    ctx->flush_bytes = 128 * 1024;
+    ctx->flush_passes = 16;
+    ctx->ticks_per_usec = CLOCK_PER_USEC;
+    memlat_calibrate(ctx);
+}
+
+// ctx->timer as the chase code takes it, NULL for the built-in timer
+static const struct chase_timer *ctx_timer(const struct memlat_ctx *ctx,
+					   struct chase_timer *t)
+{
+    if (ctx->timer.read == NULL)
+	return NULL;
+    t->read = ctx->timer.read;
+    t->arg = ctx->timer.arg;
+    return t;
+}
+
+// Measure the cost of an empty timed window with ctx->timer. Done by
+// memlat_ctx_init() for the built-in timer; call again after changing it.
+void memlat_calibrate(struct memlat_ctx *ctx)
+{
+    struct chase_timer t;
+
+    ctx->timer_overhead = chase_timer_overhead(ctx_timer(ctx, &t));
+}
+
+int memlat_pattern_from_name(const char *name)
+{
+    int i;
+
+    for (i = 0; i < MEMLAT_PAT_MAX; i++)
+	if (strcmp(name, memlat_pattern_names[i]) == 0)
+	    return i;
+    return -1;
+}
+
+const char *memlat_pattern_name(enum memlat_pattern pat)
+{
+    if ((int)pat < 0 || pat >= MEMLAT_PAT_MAX)
+	return "unknown";
+    return memlat_pattern_names[pat];
+}
+
+int memlat_encoding_from_name(const char *name)
+{
+    return chase_encoding_from_name(name);
+}
+
+int memlat_unroll_supported(long unroll)
+{
+    return chase_unroll_supported(unroll);
+}
+
+int memlat_buffer_alloc(const struct memlat_ctx *ctx, size_t size,
+			struct memlat_buffer *buf)
+{
+    return ctx->provider.alloc(ctx->provider.arg, size, buf);
+}
+
+void memlat_buffer_release(const struct memlat_ctx *ctx,
+			   struct memlat_buffer *buf)
+{
+    if (buf->base)
+	ctx->provider.release(ctx->provider.arg, buf);
+}
+
+static int build_pattern(const struct memlat_ctx *ctx, char *base,
+			 size_t size, long stride, int id)
+{
+    unsigned int seed = ctx->seed ? ctx->seed : (unsigned int)time(NULL);
+
+    // Different chains of one context get different but reproducible orders
+    seed ^= (unsigned int)id * 2654435761u;
+
+    switch (ctx->pattern) {
+    case MEMLAT_PAT_SEQUENTIAL:
+	if (size & (size - 1))
+	    return -1;
+	prepare_mem_for_latency_test(base, size, stride);
+	break;
+    case MEMLAT_PAT_RANDOM:
+	prepare_mem_for_latency_test_random_r(base, size, stride, &seed);
+	break;
+    case MEMLAT_PAT_FULLRANDOM:
+	prepare_mem_for_latency_test_fullrandom_r(base, size, stride, &seed);
+	break;
+    case MEMLAT_PAT_RANDOM_AND_SEQUENTIAL:
+	prepare_mem_for_latency_test_random_and_sequential_r(base, size, stride,
+							     &seed);
+	break;
+    default:
+	return -1;
+    }
+    return convert_chain_encoding(base, size,
+				  (enum chase_encoding)ctx->encoding);
+}
+
+// Bytes a chain of 'size' needs: room to prepare the pattern and to lay it
+// out with the node size of ctx->encoding
+size_t memlat_chain_bytes(const struct memlat_ctx *ctx, size_t size)
+{
+    long footprint = chain_footprint(size, (enum chase_encoding)ctx->encoding);
+
+    return footprint > (long)size ? (size_t)footprint : size;
+}
+
+// Build the chain in 'base', which must hold memlat_chain_bytes(), or in
+// memory from the provider when base is NULL. Nothing is done if the chain
+// already holds the same layout, which lets callers reuse chains across
+// measurements.
+int memlat_chain_build(const struct memlat_ctx *ctx, struct memlat_chain *chain,
+		       void *base, size_t size, long stride)
+{
+    if (stride < (long)sizeof(uintptr_t) || size < (size_t)stride * 2 ||
+	size % stride)
+	return -1;
+
+    if (chain->base && chain->size == size && chain->stride == stride &&
+	chain->pattern == ctx->pattern && chain->encoding == ctx->encoding &&
+	(base == NULL ? chain->owned : chain->base == base))
+	goto flush;
+
+    if (chain->owned && (base != NULL ||
+			 chain->buf.size < memlat_chain_bytes(ctx, size))) {
+	memlat_buffer_release(ctx, &chain->buf);
+	chain->owned = 0;
+    }
+    if (base == NULL && !chain->owned) {
+	if (memlat_buffer_alloc(ctx, memlat_chain_bytes(ctx, size),
+				&chain->buf) < 0)
+	    return -1;
+	chain->owned = 1;
+    }
+    chain->base = base ? base : chain->buf.base;
+
+    if (build_pattern(ctx, chain->base, size, stride, chain->id) < 0) {
+	chain->size = 0;
+	return -1;
+    }
+    chain->size = size;
+    chain->stride = stride;
+    chain->pattern = ctx->pattern;
+    chain->encoding = ctx->encoding;
+    chain->cursor = 0;
+
+  flush:
+    if (chain->flush_bytes != ctx->flush_bytes) {
+	free(chain->flush);
+	chain->flush = NULL;
+	chain->flush_bytes = 0;
+	if (ctx->flush_bytes) {
+	    chain->flush = calloc(1, ctx->flush_bytes);
+	    if (chain->flush == NULL)
+		return -1;
+	    chain->flush_bytes = ctx->flush_bytes;
+	}
+    }
+    return 0;
+}
+
+void memlat_chain_release(const struct memlat_ctx *ctx,
+			  struct memlat_chain *chain)
+{
+    if (chain->owned)
+	memlat_buffer_release(ctx, &chain->buf);
+    free(chain->flush);
+    memset(chain, 0, sizeof(*chain));
+}
+
+// One sample: flood the caches, then chase ctx->steps steps. Returns the
+// mean ticks per step, or NAN on error.
+double memlat_measure(const struct memlat_ctx *ctx, struct memlat_chain *chain)
+{
+    long calls = ctx->steps / ctx->unroll;
+    long words = chain->flush_bytes / sizeof(long);
+    long i, temp = 0;
+    int pass;
+    struct chase_timer t;
+
+    if (chain->base == NULL || chain->size == 0)
+	return NAN;
+
+    for (pass = 0; pass < ctx->flush_passes && words; pass++)
+	for (i = 0; i < words; i++) {
+	    chain->flush[i] = i;
+	    temp += chain->flush[i];
+	}
+    asm volatile ("" : : "r"(temp) : "memory");
+
+    if (calls < 1)
+	calls = 1;
+    return chase_mem_latency_timed(chain->base, &chain->cursor,
+				   (enum chase_encoding)chain->encoding,
+				   ctx->unroll, calls, ctx_timer(ctx, &t),
+				   ctx->timer_overhead);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+int memlat_run(const struct memlat_ctx *ctx, struct memlat_chain *chain,
+	       long samples, struct memlat_stats *st)
+{
+    double *v;
+    double sum = 0;
+    long i;
+
+    if (samples < 1)
+	return -1;
+    v = malloc(samples * sizeof(double));
+    if (v == NULL)
+	return -1;
+
+    for (i = 0; i < samples; i++) {
+	v[i] = memlat_measure(ctx, chain);
+	if (isnan(v[i])) {
+	    free(v);
+	    return -1;
+	}
+	sum += v[i];
+	if (ctx->sink.sample)
+	    ctx->sink.sample(ctx->sink.arg, chain, i, v[i]);
+    }
+
+    qsort(v, samples, sizeof(double), cmp_double);
+    st->n = samples;
+    st->mean = sum / samples;
+    st->min = v[0];
+    st->max = v[samples - 1];
+    st->median = (samples & 1) ? v[samples / 2] :
+	(v[samples / 2 - 1] + v[samples / 2]) / 2;
+    st->trimmed_mean = samples > 2 ?
+	(sum - st->min - st->max) / (samples - 2) : st->mean;
+    free(v);
+
+    if (ctx->sink.done)
+	ctx->sink.done(ctx->sink.arg, chain, st);
+    return 0;
+}
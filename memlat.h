@@ -0,0 +1,139 @@
+// libmemlat: embeddable memory latency probe.
+//
+// Everything a probe needs is held in a struct memlat_ctx (where memory comes
+// from, which chain to build, how to time it and where samples go) and in the
+// struct memlat_chain objects built with it; there is no global state. The
+// context is only read while measuring, so several threads can measure their
+// own chains with one context. Only memlat_ names are part of the API;
+// the chase kernels behind it stay internal.
+//
+//	struct memlat_ctx ctx;
+//	struct memlat_chain chain = { 0 };
+//	struct memlat_stats st;
+//
+//	memlat_ctx_init(&ctx);
+//	memlat_chain_build(&ctx, &chain, NULL, 64 << 20, 4096);
+//	memlat_run(&ctx, &chain, 10, &st);
+//	memlat_chain_release(&ctx, &chain);
+#ifndef MEMLAT_H
+#define MEMLAT_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Node layout of a chain
+enum memlat_encoding {
+    MEMLAT_ENC_ABS64,		// 64-bit absolute pointer per node
+    MEMLAT_ENC_REL32,		// 32-bit byte offset from the buffer base
+    MEMLAT_ENC_PACKED,		// 32-bit offset plus a 32-bit payload
+    MEMLAT_ENC_ABS64P,		// 64-bit pointer plus a 64-bit payload
+    MEMLAT_ENC_MAX
+};
+
+// Clock used around each chase, in ticks
+struct memlat_timer {
+    uintptr_t (*read)(void *arg);
+    void *arg;
+};
+
+enum memlat_pattern {
+    MEMLAT_PAT_SEQUENTIAL,	// fixed stride, size must be a power of two
+    MEMLAT_PAT_RANDOM,		// random stride up to 2 * stride
+    MEMLAT_PAT_FULLRANDOM,	// size / stride nodes at random positions
+    MEMLAT_PAT_RANDOM_AND_SEQUENTIAL,	// random stride-sized blocks walked sequentially
+    MEMLAT_PAT_MAX
+};
+
+struct memlat_buffer {
+    void *base;
+    size_t size;
+    void *priv;			// provider private data
+};
+
+// Where chain memory comes from. alloc returns 0 or -1 with errno set.
+struct memlat_provider {
+    const char *name;
+    int (*alloc)(void *arg, size_t size, struct memlat_buffer *buf);
+    void (*release)(void *arg, struct memlat_buffer *buf);
+    void *arg;
+};
+
+// Argument of the memlat_provider_devmem() provider, e.g. MECA memory
+struct memlat_devmem {
+    const char *dev;
+    unsigned long offset;
+};
+
+// Latencies in timer ticks per chase step
+struct memlat_stats {
+    long n;
+    double mean;
+    double trimmed_mean;	// without min and max, as access_penalty_test
+    double median;
+    double min;
+    double max;
+};
+
+struct memlat_chain;
+
+// Receives every sample and the final statistics of memlat_run(). It is
+// called from the measuring thread.
+struct memlat_sink {
+    void (*sample)(void *arg, const struct memlat_chain *chain, long index,
+		   double ticks);
+    void (*done)(void *arg, const struct memlat_chain *chain,
+		 const struct memlat_stats *st);
+    void *arg;
+};
+
+struct memlat_ctx {
+    struct memlat_provider provider;
+    enum memlat_pattern pattern;
+    enum memlat_encoding encoding;
+    long unroll;
+    long steps;			// chase steps per sample
+    size_t flush_bytes;		// cache flood before each sample, 0 = none
+    int flush_passes;
+    unsigned int seed;		// chain randomization, 0 = from the clock
+    struct memlat_timer timer;	// read == NULL: built-in timer
+    double timer_overhead;	// ticks per timed window, see memlat_calibrate()
+    double ticks_per_usec;
+    struct memlat_sink sink;
+};
+
+// A pointer chain in memory owned by the chain (base NULL at build time) or
+// by the caller. Zero it before the first memlat_chain_build().
+struct memlat_chain {
+    struct memlat_buffer buf;
+    int owned;
+    char *base;
+    size_t size;
+    long stride;
+    enum memlat_pattern pattern;
+    enum memlat_encoding encoding;
+    uintptr_t cursor;
+    long *flush;
+    size_t flush_bytes;
+    int id;			// free for the caller, e.g. thread index
+};
+
+void memlat_ctx_init(struct memlat_ctx *ctx);
+void memlat_calibrate(struct memlat_ctx *ctx);
+void memlat_provider_local(struct memlat_provider *p);
+void memlat_provider_devmem(struct memlat_provider *p, struct memlat_devmem *dm);
+int memlat_pattern_from_name(const char *name);
+const char *memlat_pattern_name(enum memlat_pattern pat);
+int memlat_encoding_from_name(const char *name);
+int memlat_unroll_supported(long unroll);
+int memlat_buffer_alloc(const struct memlat_ctx *ctx, size_t size,
+			struct memlat_buffer *buf);
+void memlat_buffer_release(const struct memlat_ctx *ctx,
+			   struct memlat_buffer *buf);
+size_t memlat_chain_bytes(const struct memlat_ctx *ctx, size_t size);
+int memlat_chain_build(const struct memlat_ctx *ctx, struct memlat_chain *chain,
+		       void *base, size_t size, long stride);
+void memlat_chain_release(const struct memlat_ctx *ctx,
+			  struct memlat_chain *chain);
+double memlat_measure(const struct memlat_ctx *ctx, struct memlat_chain *chain);
+int memlat_run(const struct memlat_ctx *ctx, struct memlat_chain *chain,
+	       long samples, struct memlat_stats *st);
+#endif
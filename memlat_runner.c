@@ -0,0 +1,462 @@
+// memlat_runner.c
+// Runs a matrix of latency tests (tier x size x stride x pattern x threads)
+// described by one config file on top of libmemlat. Each tier is mapped once
+// and split into one slice per thread; chains are only rebuilt when the size,
+// stride or pattern changes, so adding threads reuses the existing chains.
+//
+// Usage:  ./memlat_runner CONFIG [--output FILE] [--compare BASELINE]
+//
+// With a baseline the exit status is 2 on a regression and 3 if the baseline
+// does not match the config or has series that cannot be tested.
+//
+// Config file, '#' starts a comment and lists are comma separated:
+//	tiers = local, meca
+//	sizes = 1M, 64M
+//	strides = 64, 4096
+//	patterns = random_and_sequential, fullrandom
+//	threads = 1, 2
+//	encoding = abs64		# abs64 | rel32 | packed | abs64p
+//	unroll = 1024
+//	samples = 10
+//	steps = 4194304		# chase steps per sample
+//	flush_bytes = 131072		# 0 disables the cache flood
+//	seed = 0			# 0 = from the clock
+//	meca_dev = /dev/mem
+//	meca_offset = 0x200000000
+//	output = results.json		# .csv for CSV
+//	compare = baseline.json
+//	alpha = 0.01
+//	threshold_pct = 2
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include "memlat.h"
+#include "results.h"
+
+#define MAX_LIST 16
+#define MAX_THREADS 256
+
+struct list {
+    char str[256];		// as written in the config, for the results
+    char item[MAX_LIST][64];
+    int n;
+};
+
+typedef struct {
+    struct list tiers, sizes, strides, patterns, threads;
+    char encoding[16];
+    long unroll;
+    long samples;
+    long steps;
+    size_t flush_bytes;
+    unsigned int seed;
+    char meca_dev[128];
+    unsigned long meca_offset;
+    char output[256];
+    char format[8];
+    char baseline[256];
+    double alpha;
+    double threshold_pct;
+} config_t;
+
+// Shared by the measuring threads through the sink
+struct runner {
+    pthread_mutex_t lock;
+    struct result_set *res;
+    char series[128];
+    int failed;			// a sample could not be recorded
+};
+
+struct job {
+    const struct memlat_ctx *ctx;
+    struct memlat_chain *chain;
+    long samples;
+    struct memlat_stats st;
+    int ret;
+};
+
+static void die(const char *msg)
+{
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+static char *trim(char *s)
+{
+    char *e;
+
+    while (isspace((unsigned char)*s))
+	s++;
+    e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1]))
+	*--e = '\0';
+    return s;
+}
+
+static void parse_list(struct list *l, char *value)
+{
+    char *tok, *save = NULL;
+
+    snprintf(l->str, sizeof(l->str), "%s", value);
+    l->n = 0;
+    for (tok = strtok_r(value, ",", &save); tok;
+	 tok = strtok_r(NULL, ",", &save)) {
+	if (l->n == MAX_LIST)
+	    die("too many list entries");
+	snprintf(l->item[l->n++], sizeof(l->item[0]), "%s", trim(tok));
+    }
+}
+
+// Size with an optional K/M/G suffix
+static size_t parse_size(const char *s)
+{
+    char *end;
+    unsigned long long v = strtoull(s, &end, 0);
+
+    switch (toupper((unsigned char)*end)) {
+    case 'G':
+	v <<= 10;
+	/* fall through */
+    case 'M':
+	v <<= 10;
+	/* fall through */
+    case 'K':
+	v <<= 10;
+	break;
+    }
+    return v;
+}
+
+static void parse_config(const char *path, config_t *cfg)
+{
+    char line[512];
+    FILE *fp = fopen(path, "r");
+    int lineno = 0;
+
+    if (fp == NULL) {
+	fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+
+    memset(cfg, 0, sizeof(*cfg));
+    parse_list(&cfg->tiers, (char[]){ "local" });
+    parse_list(&cfg->sizes, (char[]){ "64M" });
+    parse_list(&cfg->strides, (char[]){ "4096" });
+    parse_list(&cfg->patterns, (char[]){ "random_and_sequential" });
+    parse_list(&cfg->threads, (char[]){ "1" });
+    strcpy(cfg->encoding, "abs64");
+    cfg->unroll = 1024;
+    cfg->samples = 10;
+    cfg->steps = 4096 * 1024;
+    cfg->flush_bytes = 128 * 1024;
+    strcpy(cfg->meca_dev, "/dev/mem");
+    cfg->meca_offset = 0x200000000UL;
+    cfg->alpha = 0.01;
+    cfg->threshold_pct = 2;
+
+    while (fgets(line, sizeof(line), fp)) {
+	char *key, *value, *eq;
+
+	lineno++;
+	line[strcspn(line, "#\n")] = '\0';
+	key = trim(line);
+	if (*key == '\0')
+	    continue;
+	eq = strchr(key, '=');
+	if (eq == NULL) {
+	    fprintf(stderr, "Error: %s:%d: expected key = value\n", path, lineno);
+	    exit(1);
+	}
+	*eq = '\0';
+	key = trim(key);
+	value = trim(eq + 1);
+
+	if (strcmp(key, "tiers") == 0)
+	    parse_list(&cfg->tiers, value);
+	else if (strcmp(key, "sizes") == 0)
+	    parse_list(&cfg->sizes, value);
+	else if (strcmp(key, "strides") == 0)
+	    parse_list(&cfg->strides, value);
+	else if (strcmp(key, "patterns") == 0)
+	    parse_list(&cfg->patterns, value);
+	else if (strcmp(key, "threads") == 0)
+	    parse_list(&cfg->threads, value);
+	else if (strcmp(key, "encoding") == 0)
+	    snprintf(cfg->encoding, sizeof(cfg->encoding), "%s", value);
+	else if (strcmp(key, "unroll") == 0)
+	    cfg->unroll = atol(value);
+	else if (strcmp(key, "samples") == 0)
+	    cfg->samples = atol(value);
+	else if (strcmp(key, "steps") == 0)
+	    cfg->steps = atol(value);
+	else if (strcmp(key, "flush_bytes") == 0)
+	    cfg->flush_bytes = parse_size(value);
+	else if (strcmp(key, "seed") == 0)
+	    cfg->seed = strtoul(value, NULL, 0);
+	else if (strcmp(key, "meca_dev") == 0)
+	    snprintf(cfg->meca_dev, sizeof(cfg->meca_dev), "%s", value);
+	else if (strcmp(key, "meca_offset") == 0)
+	    cfg->meca_offset = strtoul(value, NULL, 0);
+	else if (strcmp(key, "output") == 0)
+	    snprintf(cfg->output, sizeof(cfg->output), "%s", value);
+	else if (strcmp(key, "format") == 0)
+	    snprintf(cfg->format, sizeof(cfg->format), "%s", value);
+	else if (strcmp(key, "compare") == 0)
+	    snprintf(cfg->baseline, sizeof(cfg->baseline), "%s", value);
+	else if (strcmp(key, "alpha") == 0)
+	    cfg->alpha = atof(value);
+	else if (strcmp(key, "threshold_pct") == 0)
+	    cfg->threshold_pct = atof(value);
+	else {
+	    fprintf(stderr, "Error: %s:%d: unknown key %s\n", path, lineno, key);
+	    exit(1);
+	}
+    }
+    fclose(fp);
+
+    if (memlat_encoding_from_name(cfg->encoding) < 0)
+	die("bad encoding");
+    if (!memlat_unroll_supported(cfg->unroll))
+	die("bad unroll");
+    if (cfg->samples < 1 || cfg->steps < 1)
+	die("bad samples or steps");
+}
+
+static void sink_sample(void *arg, const struct memlat_chain *chain, long index,
+			double ticks)
+{
+    struct runner *r = arg;
+
+    (void)chain;
+    (void)index;
+    pthread_mutex_lock(&r->lock);
+    if (results_sample(r->res, r->series, "latency", "cycles", ticks) < 0)
+	r->failed = 1;
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void *run_job(void *arg)
+{
+    struct job *job = arg;
+
+    job->ret = memlat_run(job->ctx, job->chain, job->samples, &job->st);
+    return NULL;
+}
+
+// Measure 'threads' chains at the same time; returns the mean of the
+// per-thread trimmed means
+static int run_threads(const struct memlat_ctx *ctx, struct memlat_chain *chains,
+		       int threads, long samples, double *latency)
+{
+    pthread_t tid[MAX_THREADS];
+    struct job jobs[MAX_THREADS];
+    double sum = 0;
+    int t, ret = 0;
+
+    for (t = 0; t < threads; t++) {
+	jobs[t] = (struct job){ ctx, &chains[t], samples, { 0 }, 0 };
+	if (t > 0 && pthread_create(&tid[t], NULL, run_job, &jobs[t]) != 0)
+	    die("pthread_create failed");
+    }
+    run_job(&jobs[0]);
+    for (t = 1; t < threads; t++)
+	pthread_join(tid[t], NULL);
+
+    for (t = 0; t < threads; t++) {
+	if (jobs[t].ret < 0)
+	    ret = -1;
+	sum += jobs[t].st.trimmed_mean;
+    }
+    *latency = sum / threads;
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    config_t cfg;
+    struct memlat_ctx ctx;
+    struct memlat_devmem devmem;
+    struct result_set res;
+    struct runner runner;
+    const char *output = NULL, *baseline = NULL;
+    size_t max_size = 0;
+    int max_threads = 1;
+    int a, i, j, k, l, ret = 0;
+
+    if (argc < 2 || argv[1][0] == '-') {
+	printf("Usage: %s CONFIG [--output FILE] [--compare BASELINE]\n"
+	       "With --compare the exit status is 2 on a regression, 3 if the baseline could not be compared\n",
+	       argv[0]);
+	return 0;
+    }
+    parse_config(argv[1], &cfg);
+    for (a = 2; a < argc; a++) {
+	if (strcmp(argv[a], "--output") == 0 && a + 1 < argc)
+	    snprintf(cfg.output, sizeof(cfg.output), "%s", argv[++a]);
+	else if (strcmp(argv[a], "--compare") == 0 && a + 1 < argc)
+	    snprintf(cfg.baseline, sizeof(cfg.baseline), "%s", argv[++a]);
+	else {
+	    fprintf(stderr, "Unknown arg: %s\n", argv[a]);
+	    return 1;
+	}
+    }
+    if (cfg.output[0])
+	output = cfg.output;
+    if (cfg.baseline[0])
+	baseline = cfg.baseline;
+    if (results_parse_format(cfg.format[0] ? cfg.format : NULL, output) < 0)
+	die("bad format");
+    if (results_same_file(output, baseline))
+	die("output would overwrite the compare baseline");
+
+    for (i = 0; i < cfg.threads.n; i++) {
+	int t = atoi(cfg.threads.item[i]);
+
+	if (t < 1 || t > MAX_THREADS)
+	    die("bad threads");
+	if (t > max_threads)
+	    max_threads = t;
+    }
+    for (i = 0; i < cfg.patterns.n; i++)
+	if (memlat_pattern_from_name(cfg.patterns.item[i]) < 0)
+	    die("bad pattern");
+
+    memlat_ctx_init(&ctx);
+    ctx.encoding = memlat_encoding_from_name(cfg.encoding);
+    ctx.unroll = cfg.unroll;
+    ctx.steps = cfg.steps;
+    ctx.flush_bytes = cfg.flush_bytes;
+    ctx.seed = cfg.seed;
+    ctx.sink.sample = sink_sample;
+    ctx.sink.arg = &runner;
+
+    // Slice size per thread, including the room the encoding needs
+    for (i = 0; i < cfg.sizes.n; i++) {
+	size_t bytes = memlat_chain_bytes(&ctx, parse_size(cfg.sizes.item[i]));
+
+	if (bytes > max_size)
+	    max_size = bytes;
+    }
+    devmem.dev = cfg.meca_dev;
+    devmem.offset = cfg.meca_offset;
+
+    results_init(&res, "memlat_runner");
+    results_config_str(&res, "tiers", cfg.tiers.str);
+    results_config_str(&res, "sizes", cfg.sizes.str);
+    results_config_str(&res, "strides", cfg.strides.str);
+    results_config_str(&res, "patterns", cfg.patterns.str);
+    results_config_str(&res, "threads", cfg.threads.str);
+    results_config_str(&res, "encoding", cfg.encoding);
+    results_config_num(&res, "unroll", cfg.unroll);
+    results_config_count(&res, "samples", cfg.samples);
+    results_config_num(&res, "steps", cfg.steps);
+    results_config_str(&res, "timer", RESULT_TIMER);
+    results_config_num(&res, "clock_per_usec", ctx.ticks_per_usec);
+    results_config_num(&res, "flush_bytes", cfg.flush_bytes);
+    results_config_str(&res, "meca_dev", cfg.meca_dev);
+    results_config_num(&res, "meca_offset", cfg.meca_offset);
+    results_add_host(&res);
+    results_summary_num(&res, "timer_overhead_cycles", ctx.timer_overhead);
+
+    pthread_mutex_init(&runner.lock, NULL);
+    runner.res = &res;
+    runner.failed = 0;
+
+    for (i = 0; i < cfg.tiers.n; i++) {
+	const char *tier = cfg.tiers.item[i];
+	struct memlat_buffer buf;
+	struct memlat_chain chains[MAX_THREADS];
+	int t;
+
+	if (strcmp(tier, "local") == 0)
+	    memlat_provider_local(&ctx.provider);
+	else if (strcmp(tier, "meca") == 0)
+	    memlat_provider_devmem(&ctx.provider, &devmem);
+	else
+	    die("unknown tier, expected local or meca");
+
+	// One mapping per tier, one max_size slice per thread
+	if (memlat_buffer_alloc(&ctx, max_size * max_threads, &buf) < 0) {
+	    printf("%s Memory allocation error: %s\n", tier, strerror(errno));
+	    ret = 1;
+	    continue;
+	}
+	memset(chains, 0, sizeof(chains));
+	for (t = 0; t < max_threads; t++)
+	    chains[t].id = t;
+
+	for (j = 0; j < cfg.sizes.n; j++)
+	    for (k = 0; k < cfg.strides.n; k++)
+		for (l = 0; l < cfg.patterns.n; l++) {
+		    size_t size = parse_size(cfg.sizes.item[j]);
+		    long stride = atol(cfg.strides.item[k]);
+		    int m;
+
+		    ctx.pattern = memlat_pattern_from_name(cfg.patterns.item[l]);
+		    for (m = 0; m < cfg.threads.n; m++) {
+			int threads = atoi(cfg.threads.item[m]);
+			double latency;
+
+			for (t = 0; t < threads; t++)
+			    if (memlat_chain_build(&ctx, &chains[t],
+						   (char *)buf.base + t * max_size,
+						   size, stride) < 0)
+				break;
+			if (t < threads) {
+			    printf("%s %zu %ld %s: cannot build chain\n", tier,
+				   size, stride, cfg.patterns.item[l]);
+			    ret = 1;
+			    break;
+			}
+
+			snprintf(runner.series, sizeof(runner.series),
+				 "%s:%zu:%ld:%s:t%d", tier, size, stride,
+				 cfg.patterns.item[l], threads);
+			if (run_threads(&ctx, chains, threads, cfg.samples,
+					&latency) < 0) {
+			    printf("%s: measurement error\n", runner.series);
+			    ret = 1;
+			    continue;
+			}
+			if (runner.failed) {
+			    printf("%s: cannot record samples\n",
+				   runner.series);
+			    runner.failed = 0;
+			    ret = 1;
+			    continue;
+			}
+			printf("%s: %.4lf usec\n", runner.series,
+			       latency / ctx.ticks_per_usec);
+			fflush(stdout);
+		    }
+		}
+
+	for (t = 0; t < max_threads; t++)
+	    memlat_chain_release(&ctx, &chains[t]);
+	memlat_buffer_release(&ctx, &buf);
+    }
+
+    if (output && results_write(&res, output,
+				results_parse_format(cfg.format[0] ? cfg.format : NULL,
+						     output)) < 0)
+	ret = 1;
+
+    // Exit with RESULT_CMP_* so rollouts can be gated on it
+    if (baseline) {
+	int status = results_compare(&res, baseline, cfg.alpha,
+				     cfg.threshold_pct, stdout);
+	if (status < 0)
+	    ret = 1;
+	else if (ret == 0)
+	    ret = status;
+    }
+
+    results_free(&res);
+    pthread_mutex_destroy(&runner.lock);
+    return ret;
+}
@@ -0,0 +1,784 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include "results.h"
+
+void results_init(struct result_set *r, const char *program)
+{
+    memset(r, 0, sizeof(*r));
+    r->program = program;
+}
+
+void results_free(struct result_set *r)
+{
+    int i;
+
+    for (i = 0; i < r->nseries; i++)
+	free(r->series[i].samples);
+    free(r->series);
+    free(r->config.kv);
+    free(r->host.kv);
+    free(r->summary.kv);
+    results_init(r, r->program);
+}
+
+static const struct result_kv *kv_find(const struct result_kv_list *l,
+				       const char *key)
+{
+    int i;
+
+    for (i = 0; i < l->n; i++)
+	if (strcmp(l->kv[i].key, key) == 0)
+	    return &l->kv[i];
+    return NULL;
+}
+
+// Set 'key', adding it if needed. Keys and values that do not fit are
+// refused rather than truncated.
+static struct result_kv *kv_set(struct result_kv_list *l, const char *key,
+				const char *value, int is_number)
+{
+    struct result_kv *kv = NULL;
+    int i;
+
+    if (strlen(key) >= sizeof(kv->key) || strlen(value) >= sizeof(kv->value))
+	return NULL;
+    for (i = 0; i < l->n && kv == NULL; i++)
+	if (strcmp(l->kv[i].key, key) == 0)
+	    kv = &l->kv[i];
+    if (kv == NULL) {
+	if (l->n == l->cap) {
+	    int cap = l->cap ? l->cap * 2 : 16;
+	    struct result_kv *p = realloc(l->kv, cap * sizeof(*p));
+
+	    if (p == NULL)
+		return NULL;
+	    l->kv = p;
+	    l->cap = cap;
+	}
+	kv = &l->kv[l->n++];
+	snprintf(kv->key, sizeof(kv->key), "%s", key);
+    }
+    snprintf(kv->value, sizeof(kv->value), "%s", value);
+    kv->is_number = is_number;
+    kv->is_count = 0;
+    return kv;
+}
+
+static struct result_kv *kv_set_num(struct result_kv_list *l, const char *key,
+				    double value)
+{
+    char buf[64];
+
+    if (!isfinite(value))
+	return kv_set(l, key, "null", 1);
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    return kv_set(l, key, buf, 1);
+}
+
+int results_config_str(struct result_set *r, const char *key, const char *value)
+{
+    return kv_set(&r->config, key, value, 0) ? 0 : -1;
+}
+
+int results_config_num(struct result_set *r, const char *key, double value)
+{
+    return kv_set_num(&r->config, key, value) ? 0 : -1;
+}
+
+// A sample or repetition count. It is recorded like any other setting, but
+// results_compare() accepts a baseline taken with a different count.
+int results_config_count(struct result_set *r, const char *key, long value)
+{
+    struct result_kv *kv = kv_set_num(&r->config, key, value);
+
+    if (kv == NULL)
+	return -1;
+    kv->is_count = 1;
+    return 0;
+}
+
+int results_summary_num(struct result_set *r, const char *key, double value)
+{
+    return kv_set_num(&r->summary, key, value) ? 0 : -1;
+}
+
+// First value of 'field' in /proc/cpuinfo ("model name" on x86, "uarch" or
+// "isa" on RISC-V)
+static int cpuinfo_field(const char *field, char *out, size_t len)
+{
+    char line[256];
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    size_t flen = strlen(field);
+    int found = 0;
+
+    if (fp == NULL)
+	return 0;
+    while (!found && fgets(line, sizeof(line), fp)) {
+	char *p = line;
+
+	if (strncmp(line, field, flen) != 0)
+	    continue;
+	p += flen;
+	while (*p == ' ' || *p == '\t')
+	    p++;
+	if (*p != ':')
+	    continue;
+	p++;
+	while (*p == ' ')
+	    p++;
+	p[strcspn(p, "\n")] = '\0';
+	snprintf(out, len, "%s", p);
+	found = 1;
+    }
+    fclose(fp);
+    return found;
+}
+
+static int count_numa_nodes(void)
+{
+    DIR *dir = opendir("/sys/devices/system/node");
+    struct dirent *de;
+    int n = 0;
+
+    if (dir == NULL)
+	return 1;
+    while ((de = readdir(dir)) != NULL)
+	if (strncmp(de->d_name, "node", 4) == 0 && isdigit(de->d_name[4]))
+	    n++;
+    closedir(dir);
+    return n ? n : 1;
+}
+
+void results_add_host(struct result_set *r)
+{
+    struct utsname uts;
+    char buf[128];
+
+    if (gethostname(buf, sizeof(buf)) == 0) {
+	buf[sizeof(buf) - 1] = '\0';
+	kv_set(&r->host, "hostname", buf, 0);
+    }
+    if (uname(&uts) == 0) {
+	kv_set(&r->host, "machine", uts.machine, 0);
+	kv_set(&r->host, "kernel", uts.release, 0);
+    }
+    if (cpuinfo_field("model name", buf, sizeof(buf)) ||
+	cpuinfo_field("uarch", buf, sizeof(buf)) ||
+	cpuinfo_field("isa", buf, sizeof(buf)))
+	kv_set(&r->host, "cpu", buf, 0);
+    kv_set_num(&r->host, "cpus_online",
+	       sysconf(_SC_NPROCESSORS_ONLN));
+    kv_set_num(&r->host, "numa_nodes", count_numa_nodes());
+    kv_set_num(&r->host, "page_size", sysconf(_SC_PAGESIZE));
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    kv_set_num(&r->host, "l1d_size", sysconf(_SC_LEVEL1_DCACHE_SIZE));
+    kv_set_num(&r->host, "l2_size", sysconf(_SC_LEVEL2_CACHE_SIZE));
+    kv_set_num(&r->host, "l3_size", sysconf(_SC_LEVEL3_CACHE_SIZE));
+#endif
+}
+
+static struct result_series *series_get(struct result_set *r, const char *name,
+					const char *metric, const char *unit)
+{
+    struct result_series *s;
+    int i;
+
+    for (i = 0; i < r->nseries; i++) {
+	s = &r->series[i];
+	if (strcmp(s->name, name) == 0 && strcmp(s->metric, metric) == 0)
+	    return s;
+    }
+    if (strlen(name) >= sizeof(s->name) || strlen(metric) >= sizeof(s->metric)
+	|| strlen(unit) >= sizeof(s->unit))
+	return NULL;
+    if (r->nseries == r->series_cap) {
+	int cap = r->series_cap ? r->series_cap * 2 : 16;
+
+	s = realloc(r->series, cap * sizeof(*s));
+	if (s == NULL)
+	    return NULL;
+	r->series = s;
+	r->series_cap = cap;
+    }
+    s = &r->series[r->nseries++];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    snprintf(s->metric, sizeof(s->metric), "%s", metric);
+    snprintf(s->unit, sizeof(s->unit), "%s", unit);
+    return s;
+}
+
+int results_sample(struct result_set *r, const char *name, const char *metric,
+		   const char *unit, double value)
+{
+    struct result_series *s = series_get(r, name, metric, unit);
+
+    if (s == NULL)
+	return -1;
+    if (s->n == s->cap) {
+	long cap = s->cap ? s->cap * 2 : 64;
+	double *p = realloc(s->samples, cap * sizeof(double));
+
+	if (p == NULL)
+	    return -1;
+	s->samples = p;
+	s->cap = cap;
+    }
+    s->samples[s->n++] = value;
+    return 0;
+}
+
+int results_parse_format(const char *name, const char *path)
+{
+    const char *ext;
+
+    if (name != NULL) {
+	if (strcmp(name, "json") == 0)
+	    return RESULT_FMT_JSON;
+	if (strcmp(name, "csv") == 0)
+	    return RESULT_FMT_CSV;
+	return -1;
+    }
+    ext = path ? strrchr(path, '.') : NULL;
+    if (ext && strcmp(ext, ".csv") == 0)
+	return RESULT_FMT_CSV;
+    return RESULT_FMT_JSON;
+}
+
+// Whether both paths name the same existing file. Writing --output over
+// the --compare baseline would make the run compare against itself.
+int results_same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+
+    if (a == NULL || b == NULL || stat(a, &sa) < 0 || stat(b, &sb) < 0)
+	return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static void json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(fp, "\\u%04x", (unsigned char)*s);
+	else
+	    fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void json_kv(FILE *fp, const char *section,
+		    const struct result_kv_list *l)
+{
+    const struct result_kv *kv = l->kv;
+    int i, n = l->n;
+
+    fprintf(fp, "  \"%s\": {", section);
+    for (i = 0; i < n; i++) {
+	fprintf(fp, "%s\n    ", i ? "," : "");
+	json_string(fp, kv[i].key);
+	fprintf(fp, ": ");
+	if (kv[i].is_number)
+	    fputs(kv[i].value, fp);
+	else
+	    json_string(fp, kv[i].value);
+    }
+    fprintf(fp, "%s},\n", n ? "\n  " : "");
+}
+
+static void write_json(const struct result_set *r, FILE *fp)
+{
+    int i;
+    long j;
+
+    fprintf(fp, "{\n  \"program\": ");
+    json_string(fp, r->program);
+    fprintf(fp, ",\n");
+    json_kv(fp, "config", &r->config);
+    json_kv(fp, "host", &r->host);
+    json_kv(fp, "summary", &r->summary);
+    fprintf(fp, "  \"series\": [");
+    for (i = 0; i < r->nseries; i++) {
+	const struct result_series *s = &r->series[i];
+
+	fprintf(fp, "%s\n    {\"name\": ", i ? "," : "");
+	json_string(fp, s->name);
+	fprintf(fp, ", \"metric\": ");
+	json_string(fp, s->metric);
+	fprintf(fp, ", \"unit\": ");
+	json_string(fp, s->unit);
+	fprintf(fp, ", \"samples\": [");
+	for (j = 0; j < s->n; j++)
+	    fprintf(fp, "%s%.17g", j ? ", " : "", s->samples[j]);
+	fprintf(fp, "]}");
+    }
+    fprintf(fp, "%s]\n}\n", r->nseries ? "\n  " : "");
+}
+
+static void csv_kv(FILE *fp, const char *section,
+		   const struct result_kv_list *l)
+{
+    int i;
+
+    for (i = 0; i < l->n; i++)
+	fprintf(fp, "# %s.%s=%s\n", section, l->kv[i].key, l->kv[i].value);
+}
+
+static void write_csv(const struct result_set *r, FILE *fp)
+{
+    int i;
+    long j;
+
+    fprintf(fp, "# program=%s\n", r->program);
+    csv_kv(fp, "config", &r->config);
+    csv_kv(fp, "host", &r->host);
+    csv_kv(fp, "summary", &r->summary);
+    fprintf(fp, "series,metric,unit,index,value\n");
+    for (i = 0; i < r->nseries; i++) {
+	const struct result_series *s = &r->series[i];
+
+	for (j = 0; j < s->n; j++)
+	    fprintf(fp, "%s,%s,%s,%ld,%.17g\n", s->name, s->metric, s->unit,
+		    j, s->samples[j]);
+    }
+}
+
+int results_write(const struct result_set *r, const char *path, int format)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL) {
+	fprintf(stderr, "Result file open error: %s\n", strerror(errno));
+	return -1;
+    }
+    if (format == RESULT_FMT_CSV)
+	write_csv(r, fp);
+    else
+	write_json(r, fp);
+    if (fclose(fp) != 0) {
+	fprintf(stderr, "Result file write error: %s\n", strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+// Copy the JSON string starting at p (just after the opening quote)
+static const char *json_read_string(const char *p, char *out, size_t len)
+{
+    size_t i = 0;
+
+    while (*p && *p != '"') {
+	if (*p == '\\' && p[1])
+	    p++;
+	if (i + 1 < len)
+	    out[i++] = *p;
+	p++;
+    }
+    out[i] = '\0';
+    return *p ? p + 1 : p;
+}
+
+static const char *json_field(const char *p, const char *key)
+{
+    char pat[40];
+
+    snprintf(pat, sizeof(pat), "\"%s\"", key);
+    p = strstr(p, pat);
+    if (p == NULL)
+	return NULL;
+    p = strchr(p + strlen(pat), ':');
+    if (p == NULL)
+	return NULL;
+    p++;
+    while (isspace((unsigned char)*p))
+	p++;
+    return p;
+}
+
+// The "config" object written by json_kv()
+static int load_json_config(struct result_set *b, const char *text)
+{
+    const char *p = json_field(text, "config");
+    char key[32], value[256];
+    int is_number;
+
+    if (p == NULL || *p != '{')
+	return -1;
+    p++;
+    for (;;) {
+	while (isspace((unsigned char)*p) || *p == ',')
+	    p++;
+	if (*p == '}')
+	    return 0;
+	if (*p != '"')
+	    return -1;
+	p = json_read_string(p + 1, key, sizeof(key));
+	while (isspace((unsigned char)*p))
+	    p++;
+	if (*p++ != ':')
+	    return -1;
+	while (isspace((unsigned char)*p))
+	    p++;
+	if (*p == '"') {
+	    p = json_read_string(p + 1, value, sizeof(value));
+	    is_number = 0;
+	} else {
+	    size_t len = strcspn(p, ",}\n");
+
+	    snprintf(value, sizeof(value), "%.*s", (int)len, p);
+	    p += len;
+	    is_number = 1;
+	}
+	if (kv_set(&b->config, key, value, is_number) == NULL)
+	    return -1;
+    }
+}
+
+// Only understands the layout written by write_json()
+static int load_json(struct result_set *b, char *program, size_t plen,
+		     const char *text)
+{
+    const char *p = json_field(text, "program");
+    char name[64], metric[16], unit[16];
+
+    if (p && *p == '"')
+	json_read_string(p + 1, program, plen);
+    if (load_json_config(b, text) < 0)
+	return -1;
+    p = json_field(text, "series");
+
+    while (p && (p = json_field(p, "name")) && *p == '"') {
+	p = json_read_string(p + 1, name, sizeof(name));
+	if ((p = json_field(p, "metric")) == NULL || *p != '"')
+	    return -1;
+	p = json_read_string(p + 1, metric, sizeof(metric));
+	if ((p = json_field(p, "unit")) == NULL || *p != '"')
+	    return -1;
+	p = json_read_string(p + 1, unit, sizeof(unit));
+	if ((p = json_field(p, "samples")) == NULL || *p != '[')
+	    return -1;
+	p++;
+	for (;;) {
+	    char *end;
+	    double v;
+
+	    while (isspace((unsigned char)*p) || *p == ',')
+		p++;
+	    if (*p == ']')
+		break;
+	    v = strtod(p, &end);
+	    if (end == p)
+		return -1;
+	    if (results_sample(b, name, metric, unit, v) < 0)
+		return -1;
+	    p = end;
+	}
+    }
+    return 0;
+}
+
+static int load_csv(struct result_set *b, char *program, size_t plen,
+		    const char *text)
+{
+    const char *p = text;
+    char name[64], metric[16], unit[16], key[32], value[256];
+    long idx;
+    double v;
+
+    while (*p) {
+	const char *eol = strchr(p, '\n');
+	int n;
+
+	if (strncmp(p, "# program=", 10) == 0) {
+	    snprintf(program, plen, "%.*s",
+		     (int)(eol ? eol - p - 10 : (long)strlen(p + 10)), p + 10);
+	} else if ((n = sscanf(p, "# config.%31[^=]=%255[^\n]", key,
+			       value)) >= 1) {
+	    if (n == 1)
+		value[0] = '\0';
+	    if (kv_set(&b->config, key, value, 0) == NULL)
+		return -1;
+	} else if (*p != '#' && strncmp(p, "series,", 7) != 0 &&
+		   sscanf(p, "%63[^,],%15[^,],%15[^,],%ld,%lf",
+			  name, metric, unit, &idx, &v) == 5) {
+	    if (results_sample(b, name, metric, unit, v) < 0)
+		return -1;
+	}
+	if (eol == NULL)
+	    break;
+	p = eol + 1;
+    }
+    return 0;
+}
+
+static int results_load(struct result_set *b, char *program, size_t plen,
+			const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char *text;
+    long len;
+    const char *p;
+    int ret;
+
+    if (fp == NULL) {
+	fprintf(stderr, "Baseline file open error: %s\n", strerror(errno));
+	return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    text = malloc(len + 1);
+    if (text == NULL || (long)fread(text, 1, len, fp) != len) {
+	fprintf(stderr, "Baseline file read error\n");
+	free(text);
+	fclose(fp);
+	return -1;
+    }
+    text[len] = '\0';
+    fclose(fp);
+
+    for (p = text; isspace((unsigned char)*p); p++)
+	;
+    program[0] = '\0';
+    ret = (*p == '{') ? load_json(b, program, plen, text) :
+	load_csv(b, program, plen, text);
+    if (ret < 0)
+	fprintf(stderr, "Baseline file parse error: %s\n", path);
+    free(text);
+    return ret;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double median(const double *v, long n)
+{
+    double *s = malloc(n * sizeof(double));
+    double m;
+
+    if (s == NULL)
+	return NAN;
+    memcpy(s, v, n * sizeof(double));
+    qsort(s, n, sizeof(double), cmp_double);
+    m = (n & 1) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+    free(s);
+    return m;
+}
+
+struct ranked {
+    double v;
+    int cur;			// 1 if the sample belongs to the current run
+};
+
+static int cmp_ranked(const void *a, const void *b)
+{
+    return cmp_double(&((const struct ranked *)a)->v,
+		      &((const struct ranked *)b)->v);
+}
+
+// P(U >= u) under the null hypothesis, normal approximation with tie and
+// continuity correction. 'ties' is the sum of t^3 - t over tied groups.
+static double mann_whitney_p(double u, long n1, long n2, double ties)
+{
+    double n = n1 + n2;
+    double mu = n1 * n2 / 2.0;
+    double var = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)));
+
+    if (var <= 0)
+	return 1.0;		// all samples identical
+    return 0.5 * erfc((u - mu - 0.5) / sqrt(var) / sqrt(2));
+}
+
+// One-sided Mann-Whitney U test that 'cur' is stochastically greater than
+// 'base'.
+static double mann_whitney_greater(const double *cur, long n1,
+				   const double *base, long n2, double *u_out)
+{
+    long n = n1 + n2, i, j;
+    struct ranked *all = malloc(n * sizeof(*all));
+    double r1 = 0, ties = 0, u;
+
+    if (all == NULL)
+	return NAN;
+    for (i = 0; i < n1; i++)
+	all[i] = (struct ranked){ cur[i], 1 };
+    for (i = 0; i < n2; i++)
+	all[n1 + i] = (struct ranked){ base[i], 0 };
+    qsort(all, n, sizeof(*all), cmp_ranked);
+
+    for (i = 0; i < n; i = j) {
+	double rank, t;
+
+	for (j = i + 1; j < n && all[j].v == all[i].v; j++)
+	    ;
+	t = j - i;
+	rank = (i + 1 + j) / 2.0;	// average of ranks i+1 .. j
+	ties += t * t * t - t;
+	while (i < j) {
+	    if (all[i].cur)
+		r1 += rank;
+	    i++;
+	}
+    }
+    free(all);
+
+    u = r1 - n1 * (n1 + 1) / 2.0;
+    *u_out = u;
+    return mann_whitney_p(u, n1, n2, ties);
+}
+
+static const struct result_series *series_find(const struct result_set *r,
+					       const struct result_series *s)
+{
+    int i;
+
+    for (i = 0; i < r->nseries; i++)
+	if (strcmp(r->series[i].name, s->name) == 0 &&
+	    strcmp(r->series[i].metric, s->metric) == 0)
+	    return &r->series[i];
+    return NULL;
+}
+
+// Comparison report line, dropped when the caller passed no report stream
+static void report(FILE *out, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (out == NULL)
+	return;
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+}
+
+// Report every setting that differs from the baseline, sample counts aside.
+// Returns the number of differences.
+static int config_mismatch(FILE *out, const struct result_set *r,
+			   const struct result_set *b, const char *program)
+{
+    const struct result_kv *kv;
+    int i, n = 0;
+
+    if (strcmp(program, r->program) != 0) {
+	report(out, "program: baseline %s, current %s\n", program, r->program);
+	n++;
+    }
+    for (i = 0; i < r->config.n; i++) {
+	const struct result_kv *c = &r->config.kv[i];
+
+	if (c->is_count)
+	    continue;
+	kv = kv_find(&b->config, c->key);
+	if (kv == NULL || strcmp(kv->value, c->value) != 0) {
+	    report(out, "config %s: baseline %s, current %s\n", c->key,
+		   kv ? kv->value : "(unset)", c->value);
+	    n++;
+	}
+    }
+    for (i = 0; i < b->config.n; i++)
+	if (kv_find(&r->config, b->config.kv[i].key) == NULL) {
+	    report(out, "config %s: baseline %s, current (unset)\n",
+		   b->config.kv[i].key, b->config.kv[i].value);
+	    n++;
+	}
+    return n;
+}
+
+// Returns RESULT_CMP_REGRESSION if a series regressed, otherwise
+// RESULT_CMP_INCOMPLETE if the baseline does not match the run or a series
+// could not be tested, RESULT_CMP_OK when every series was tested and
+// passed, or -1 if the baseline cannot be read. The per-series report goes
+// to 'out' (may be NULL), read errors to stderr.
+int results_compare(const struct result_set *r, const char *baseline_path,
+		    double alpha, double threshold_pct, FILE *out)
+{
+    struct result_set base;
+    char program[64];
+    int i, regressions = 0, untested = 0;
+
+    results_init(&base, NULL);
+    if (results_load(&base, program, sizeof(program), baseline_path) < 0) {
+	results_free(&base);
+	return -1;
+    }
+
+    report(out, "\nComparison against %s (Mann-Whitney, alpha %g, threshold %g%%)\n",
+	   baseline_path, alpha, threshold_pct);
+    if (config_mismatch(out, r, &base, program)) {
+	report(out, "Baseline was taken with a different configuration, not compared\n");
+	results_free(&base);
+	return RESULT_CMP_INCOMPLETE;
+    }
+
+    for (i = 0; i < r->nseries; i++) {
+	const struct result_series *c = &r->series[i];
+	const struct result_series *b = series_find(&base, c);
+	// lower is better for latency, higher is better for bandwidth
+	int higher_is_better = strcmp(c->metric, "bandwidth") == 0;
+	double mc, mb, delta, p, u;
+	const char *verdict;
+
+	if (b == NULL) {
+	    report(out, "%-8s %-9s: not in baseline\n", c->name, c->metric);
+	    untested++;
+	    continue;
+	}
+	// Even a complete separation of the two sides cannot reach alpha
+	p = mann_whitney_p((double)c->n * b->n, c->n, b->n, 0);
+	if (p >= alpha) {
+	    report(out, "%-8s %-9s: too few samples (%ld current, %ld baseline), p >= %.4g at best\n",
+		   c->name, c->metric, c->n, b->n, p);
+	    untested++;
+	    continue;
+	}
+
+	mc = median(c->samples, c->n);
+	mb = median(b->samples, b->n);
+	delta = mb != 0 ? (mc - mb) / mb * 100 : 0;
+	if (higher_is_better)
+	    p = mann_whitney_greater(b->samples, b->n, c->samples, c->n, &u);
+	else
+	    p = mann_whitney_greater(c->samples, c->n, b->samples, b->n, &u);
+
+	if (p < alpha && (higher_is_better ? -delta : delta) > threshold_pct) {
+	    verdict = "REGRESSION";
+	    regressions++;
+	} else {
+	    verdict = "ok";
+	}
+	report(out, "%-8s %-9s: baseline median %.4f, current median %.4f %s (%+.2f%%), U = %.1f, p = %.4g  %s\n",
+	       c->name, c->metric, mb, mc, c->unit, delta, u, p, verdict);
+    }
+    for (i = 0; i < base.nseries; i++)
+	if (series_find(r, &base.series[i]) == NULL) {
+	    report(out, "%-8s %-9s: only in baseline\n", base.series[i].name,
+		   base.series[i].metric);
+	    untested++;
+	}
+
+    results_free(&base);
+    if (regressions)
+	return RESULT_CMP_REGRESSION;
+    if (untested) {
+	report(out, "%d series not compared\n", untested);
+	return RESULT_CMP_INCOMPLETE;
+    }
+    return RESULT_CMP_OK;
+}
@@ -0,0 +1,78 @@
+// Machine readable results (JSON or CSV) and baseline comparison.
+//
+// A result set holds the run configuration, host description, summary
+// values and every raw sample grouped in named series. results_compare()
+// reads a file written by results_write() and runs a one-sided Mann-Whitney
+// U test per series to flag statistically significant regressions. It only
+// compares like with like: the program and configuration must match and
+// every series must be present, with enough samples to reach alpha, on
+// both sides.
+#ifndef RESULTS_H
+#define RESULTS_H
+#include <stdio.h>
+
+#ifdef USE_RDCYCLE
+#define RESULT_TIMER "rdcycle"
+#else
+#define RESULT_TIMER "gettimeofday"
+#endif
+
+// results_compare() status, also used as the exit status of the programs
+#define RESULT_CMP_OK 0
+#define RESULT_CMP_REGRESSION 2	// at least one series got significantly worse
+#define RESULT_CMP_INCOMPLETE 3	// config mismatch, missing or underpowered series
+
+enum result_format {
+    RESULT_FMT_JSON,
+    RESULT_FMT_CSV
+};
+
+struct result_kv {
+    char key[32];
+    char value[256];
+    int is_number;
+    int is_count;		// sample count, may differ from the baseline
+};
+
+struct result_kv_list {
+    struct result_kv *kv;
+    int n;
+    int cap;
+};
+
+struct result_series {
+    char name[64];		// e.g. "local", "meca"
+    char metric[16];		// "latency" (lower is better) or "bandwidth"
+    char unit[16];
+    double *samples;
+    long n;
+    long cap;
+};
+
+struct result_set {
+    const char *program;
+    struct result_kv_list config;
+    struct result_kv_list host;
+    struct result_kv_list summary;
+    struct result_series *series;
+    int nseries;
+    int series_cap;
+};
+
+void results_init(struct result_set *r, const char *program);
+void results_free(struct result_set *r);
+// The setters return 0, or -1 if the key or series name is too long or
+// memory runs out
+int results_config_str(struct result_set *r, const char *key, const char *value);
+int results_config_num(struct result_set *r, const char *key, double value);
+int results_config_count(struct result_set *r, const char *key, long value);
+int results_summary_num(struct result_set *r, const char *key, double value);
+void results_add_host(struct result_set *r);
+int results_sample(struct result_set *r, const char *name, const char *metric,
+		   const char *unit, double value);
+int results_parse_format(const char *name, const char *path);
+int results_same_file(const char *a, const char *b);
+int results_write(const struct result_set *r, const char *path, int format);
+int results_compare(const struct result_set *r, const char *baseline_path,
+		    double alpha, double threshold_pct, FILE *out);
+#endif
@@ -13,6 +13,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include "results.h"
 
 #ifndef likely
 #define likely(x)   __builtin_expect(!!(x),1)
@@ -28,6 +29,12 @@ typedef struct {
     uint64_t iters;       // 측정 반복 횟수(접근 횟수)
     int warmup;           // 측정 전 워밍업 여부
     int use_meca;         // MECA 메모리 사용 여부
+    int repeat;           // 측정 반복 횟수(샘플 수)
+    const char* output;   // 결과 파일(JSON/CSV)
+    const char* format;   // json|csv, 없으면 확장자로 결정
+    const char* baseline; // 비교할 기준 결과 파일
+    double alpha;         // Mann-Whitney 유의수준
+    double threshold_pct; // 회귀로 판단할 최소 변화율(%)
 } config_t;
 
 static void die(const char* msg){
@@ -57,6 +64,12 @@ static void parse_args(int argc, char** argv, config_t* cfg){
     cfg->iters       = 1000000ULL;
     cfg->warmup      = 1;
     cfg->use_meca    = 0;
+    cfg->repeat      = 1;
+    cfg->output      = NULL;
+    cfg->format      = NULL;
+    cfg->baseline    = NULL;
+    cfg->alpha       = 0.01;
+    cfg->threshold_pct = 2;
 
     for(int i=1;i<argc;i++){
         if(strcmp(argv[i],"--array-bytes")==0 && i+1<argc){
@@ -74,8 +87,23 @@ static void parse_args(int argc, char** argv, config_t* cfg){
         } else if(strcmp(argv[i],"--use_meca")==0 && i+1<argc){
             long long t; if(parse_arg_i(argv[++i], &t)) die("bad --use_meca");
             cfg->use_meca = (int)t;
+        } else if(strcmp(argv[i],"--repeat")==0 && i+1<argc){
+            long long t; if(parse_arg_i(argv[++i], &t) || t<=0) die("bad --repeat");
+            cfg->repeat = (int)t;
+        } else if(strcmp(argv[i],"--output")==0 && i+1<argc){
+            cfg->output = argv[++i];
+        } else if(strcmp(argv[i],"--format")==0 && i+1<argc){
+            cfg->format = argv[++i];
+        } else if(strcmp(argv[i],"--compare")==0 && i+1<argc){
+            cfg->baseline = argv[++i];
+        } else if(strcmp(argv[i],"--alpha")==0 && i+1<argc){
+            cfg->alpha = atof(argv[++i]);
+        } else if(strcmp(argv[i],"--threshold-pct")==0 && i+1<argc){
+            cfg->threshold_pct = atof(argv[++i]);
         } else if(strcmp(argv[i],"--help")==0){
-            printf("Usage: %s --reuse-bytes N [--array-bytes B] [--line-bytes L] [--iters I] [--warmup 0|1] [--use_meca 0|1]\n", argv[0]);
+            printf("Usage: %s --reuse-bytes N [--array-bytes B] [--line-bytes L] [--iters I] [--warmup 0|1] [--use_meca 0|1] [--repeat R]\n"
+                   "       [--output FILE] [--format json|csv] [--compare BASELINE] [--alpha A] [--threshold-pct P]\n"
+                   "With --compare the exit status is 2 on a regression, 3 if the baseline could not be compared\n", argv[0]);
             exit(0);
         } else {
             fprintf(stderr, "Unknown arg: %s\n", argv[i]);
@@ -85,6 +113,8 @@ static void parse_args(int argc, char** argv, config_t* cfg){
     if(cfg->line_bytes==0 || cfg->reuse_bytes<cfg->line_bytes){
         die("reuse-bytes must be >= line-bytes and non-zero");
     }
+    if(results_parse_format(cfg->format, cfg->output) < 0) die("bad --format");
+    if(results_same_file(cfg->output, cfg->baseline)) die("--output would overwrite the --compare baseline");
     if(cfg->array_bytes < cfg->reuse_bytes*2){
         // 배열이 너무 작으면 캐시 효과가 왜곡될 수 있음
         cfg->array_bytes = cfg->reuse_bytes*4;
@@ -161,6 +191,8 @@ static void build_reuse_pattern(size_t* idx, size_t nslots, size_t reuse_slots){
 #endif
 }
 
+#define CLOCK_PER_USEC 100 //100MHz
+
 #ifdef USE_RDCYCLE
 static uintptr_t rdcycle()
 {
@@ -170,7 +202,6 @@ static uintptr_t rdcycle()
 }
 #else
 #include <sys/time.h>
-#define CLOCK_PER_USEC 100 //100MHz
 static inline uintptr_t rdcycle()
 {
         struct timeval tp;
@@ -233,6 +264,26 @@ int main(int argc, char** argv){
 
 //    uint64_t begin=0, end=0;
     uintptr_t begin, end;
+
+    // 결과 파일용 설정/호스트 정보
+    struct result_set res;
+    results_init(&res, "reuse_test");
+    results_config_num(&res, "array_bytes", cfg.array_bytes);
+    results_config_num(&res, "reuse_bytes", cfg.reuse_bytes);
+    results_config_num(&res, "line_bytes", cfg.line_bytes);
+    results_config_num(&res, "iters", cfg.iters);
+    results_config_count(&res, "repeat", cfg.repeat);
+    results_config_num(&res, "warmup", cfg.warmup);
+    results_config_str(&res, "pattern", "reuse_stride");
+    results_config_str(&res, "tiers", cfg.use_meca ? "meca" : "local");
+    results_config_str(&res, "timer", RESULT_TIMER);
+    results_config_num(&res, "clock_per_usec", CLOCK_PER_USEC);
+    results_config_str(&res, "flush", "none");
+    if(cfg.use_meca){
+        results_config_str(&res, "meca_dev", MECA_DEV);
+        results_config_num(&res, "meca_offset", MECA_OFFSET);
+    }
+    results_add_host(&res);
 /*    if(USE_TSC){
         begin = rdtsc_begin();
         size_t p=0;
@@ -245,7 +296,7 @@ int main(int argc, char** argv){
         // CSV: reuse_bytes,avg_cycles,iters
         printf("%zu,%.3f,%llu\n", cfg.reuse_bytes, avg_cycles, (unsigned long long)cfg.iters);
     } else */
-	{
+    for(int r=0;r<cfg.repeat;r++){
 //        begin = nsec_now();
 	begin = rdcycle();
         size_t p=0;
@@ -260,6 +311,7 @@ int main(int argc, char** argv){
         double avg_ns = (double)(end - begin) / (double)(cfg.iters * reuse_slots);
         // CSV: reuse_bytes,avg_ns,iters
         printf("%zu bytes %.3f cycle %llu times\n", cfg.reuse_bytes, avg_ns, (unsigned long long)cfg.iters);
+        results_sample(&res, cfg.use_meca ? "meca" : "local", "latency", "cycles", avg_ns);
     }
 
     // anti-opt
@@ -273,6 +325,19 @@ int main(int argc, char** argv){
     } else {
         free((void*)buf);
     }
-    return 0;
+
+    int ret = 0;
+    if(cfg.output && results_write(&res, cfg.output, results_parse_format(cfg.format, cfg.output)) < 0)
+        ret = 1;
+    // 회귀가 있으면 2, 비교할 수 없으면 3으로 종료 (배포 게이트용)
+    if(cfg.baseline){
+        int status = results_compare(&res, cfg.baseline, cfg.alpha, cfg.threshold_pct, stdout);
+        if(status < 0) ret = 1;
+        else if(ret == 0) ret = status;
+        if(status == RESULT_CMP_INCOMPLETE && cfg.repeat < 5)
+            printf("Use a larger --repeat on both runs (at least 5 at alpha 0.01)\n");
+    }
+    results_free(&res);
+    return ret;
 }
 